@@ -58,9 +58,9 @@
 #define MAX_THREADS 8
 
 /**
- * If \c KERNEL_USE_STACK_CANARY is defined, the kernel will place a canary 
- * value at the top of each thread's stack, which it uses to determine if the 
- * thread has had a stack overflow.
+ * If \c KERNEL_USE_STACK_CANARY is defined, the kernel will place a guard zone 
+ * of canary values at the top of each thread's stack, which it checks each 
+ * time a thread yields to determine if the thread has had a stack overflow.
  */
 #define KERNEL_USE_STACK_CANARY
 
@@ -70,6 +70,171 @@
  */
 #define STACK_CANARY 0xAA
 
+/**
+ * The number of canary bytes in each thread's guard zone if 
+ * \ref KERNEL_USE_STACK_CANARY is defined.  Value must be in the range [1,8]. 
+ * A larger guard zone catches overflows that jump past a single canary byte 
+ * (for example a large local array), at a cost of 7 cycles per byte each 
+ * time a thread yields.
+ */
+#define STACK_GUARD_SIZE 4
+
+/**
+ * If \c KERNEL_USE_STACK_CHECK is defined, the timer interrupt compares the 
+ * stack pointer against the bounds of the active thread's stack on every 
+ * tick, and also checks the topmost byte of the guard zone if 
+ * \ref KERNEL_USE_STACK_CANARY is defined.  This catches overflows caused by 
+ * interrupts or by threads that rarely yield, well before the thread's next 
+ * yield.  The check costs about 35 cycles per tick (about 0.2% of the CPU at 
+ * 16 MHz).
+ */
+#define KERNEL_USE_STACK_CHECK
+
+/**
+ * \def KERNEL_USE_MESSAGES
+ * If defined, threads can exchange messages with \ref kn_send, 
+ * \ref kn_receive and \ref kn_reply.  Uses 3 bytes of RAM per thread, plus 2.
+ */
+//#define KERNEL_USE_MESSAGES
+
+/**
+ * \def KERNEL_USE_IDLE_HOOK
+ * If defined, a function registered with \ref kn_set_idle_hook is called 
+ * whenever no thread is ready to run, before the scheduler puts the MCU to 
+ * sleep.  The hook runs on a stack owned by the kernel, of size 
+ * \ref IDLE_STACK_SIZE, so it does not need a thread of its own.
+ */
+//#define KERNEL_USE_IDLE_HOOK
+
+/**
+ * The size of the stack used to run the idle hook if 
+ * \ref KERNEL_USE_IDLE_HOOK is defined.  Interrupts that occur while the hook 
+ * is running also use this stack.
+ */
+#define IDLE_STACK_SIZE 48
+
+/**
+ * \def KERNEL_USE_EDF
+ * If defined, threads created with \ref kn_create_periodic_thread are 
+ * scheduled earliest deadline first, ahead of all other threads (see 
+ * \ref kernel_edf).  Uses 12 bytes of RAM per thread, and adds a pass over 
+ * the periodic threads to every run of the scheduler.
+ */
+//#define KERNEL_USE_EDF
+
+/**
+ * \def KERNEL_USE_CYCLIC
+ * If defined, the timer interrupt can run tasks from a static schedule table 
+ * (see \ref kernel_cyclic).  While a schedule is running every tick takes the 
+ * slow path of the interrupt, which costs about 100 cycles more per tick.
+ */
+//#define KERNEL_USE_CYCLIC
+
+/**
+ * \def KERNEL_USE_NESTED_ISR
+ * If defined, interrupt handlers defined with \ref KN_NESTABLE_ISR may enable 
+ * interrupts so that other interrupts can preempt them (see 
+ * \ref kernel_isr).  Adds a few cycles to the entry and exit of each 
+ * nestable handler.
+ */
+//#define KERNEL_USE_NESTED_ISR
+
+/**
+ * \def KERNEL_USE_HOG_DETECT
+ * If defined, the timer interrupt measures how long the running thread has 
+ * gone without yielding, and keeps the longest time for each thread (see 
+ * \ref kn_thread_max_run).  Counting adds 11 cycles to each tick while a 
+ * thread is running (14 if \ref HOG_BUDGET is defined), and about 30 cycles 
+ * to each thread switch.
+ */
+//#define KERNEL_USE_HOG_DETECT
+
+/**
+ * \def HOG_BUDGET
+ * If defined along with \ref KERNEL_USE_HOG_DETECT, \ref kn_thread_hog is 
+ * called when a thread runs for more than this many milliseconds without 
+ * yielding.  Value must be in the range [1,32767].
+ */
+//#define HOG_BUDGET 10
+
+/**
+ * \def KERNEL_USE_CRITICAL_STATS
+ * If defined, the kernel times every section of its own code that runs with 
+ * interrupts disabled, and keeps the longest duration along with a histogram 
+ * (see \ref kn_critical_stats).  This bounds the latency that the kernel adds 
+ * to any interrupt.  Recording a section adds roughly 60 cycles after the 
+ * measurement ends, and a few bytes to the stack usage of each thread.
+ */
+//#define KERNEL_USE_CRITICAL_STATS
+
+/**
+ * \def CRITICAL_STATS_TIMER1
+ * If defined along with \ref KERNEL_USE_CRITICAL_STATS, the kernel runs Timer1 
+ * from the CPU clock and measures sections in cycles.  Timer1 is then not 
+ * available to the application or the \ref kernel_adc.  Otherwise sections 
+ * are measured with Timer0, which has a resolution of 64 cycles.
+ */
+//#define CRITICAL_STATS_TIMER1
+
+/**
+ * The number of buckets in the histogram of interrupts-disabled sections if 
+ * \ref KERNEL_USE_CRITICAL_STATS is defined.
+ */
+#define CRITICAL_STATS_BUCKETS 8
+
+/**
+ * The size of the receive buffer of the UART driver.  Must be a power of 2 in 
+ * the range [2,128].
+ * \see kernel_uart
+ */
+#define UART_RX_BUFFER_SIZE 32
+
+/**
+ * The size of the transmit buffer of the UART driver.  Must be a power of 2 in 
+ * the range [2,128].
+ * \see kernel_uart
+ */
+#define UART_TX_BUFFER_SIZE 32
+
+/**
+ * The number of samples in each of the two buffers of the ADC driver.  Must be 
+ * in the range [1,255], and at least the number of sampled channels.
+ * \see kernel_adc
+ */
+#define ADC_BLOCK_SIZE 16
+
+/**
+ * The number of bytes that the EEPROM driver can hold while they wait to be 
+ * written.  Each one uses 3 bytes of RAM.  Must be a power of 2 in the range 
+ * [2,128].
+ * \see kernel_eeprom
+ */
+#define EEPROM_CACHE_SIZE 16
+
+/**
+ * The size of the buffer that holds logged messages until they are sent.  
+ * Each message takes 6 bytes plus its arguments.  Must be a power of 2 in the 
+ * range [16,128].
+ * \see kernel_log
+ */
+#define LOG_BUFFER_SIZE 64
+
+/**
+ * \def KERNEL_USE_STACK_POOL
+ * If defined, only \c THREAD0 has a fixed stack.  The stacks of the other 
+ * threads are allocated from a pool of \ref STACK_POOL_SIZE bytes when they 
+ * are created with \ref kn_create_pooled_thread, and return to the pool when 
+ * they are disabled.  Uses 4 bytes of RAM per thread, or 6 if 
+ * \ref KERNEL_USE_STACK_CHECK is defined.
+ */
+//#define KERNEL_USE_STACK_POOL
+
+/**
+ * The size of the stack pool if \ref KERNEL_USE_STACK_POOL is defined.  The 
+ * pool lies directly below the stack of \c THREAD0.
+ */
+#define STACK_POOL_SIZE 256
+
 /**
  * \defgroup stack_size Thread Stack Sizes
  * 
@@ -84,24 +249,34 @@
  * .data and .bss segments, as well as the heap size if you intend to use 
  * dynamic allocation.
  * 
- * The absolute minimum stack size is 25 bytes (\ref INITIAL_STACK_USAGE); this 
- * much space is necessary for a thread to be created, and to yield without 
- * overflowing assuming that there is no stack usage within the thread itself.  
- * To do anything useful, however, a minimum stack size of 32 bytes 
- * (\ref MIN_STACK_SIZE) is enforced.
+ * A new thread's stack holds a 27 byte frame, or 30 bytes on MCUs with a 3 
+ * byte program counter (\ref INITIAL_STACK_USAGE), which must fit above the 
+ * guard zone with room for the tick interrupt to check it.  This minimum, 
+ * \ref MIN_STACK_SIZE, is enforced: 34 bytes plus \ref STACK_GUARD_SIZE on 
+ * the ATmega328P.  It assumes that there is no stack usage within the thread 
+ * itself.
  * 
  * \warning If stack canaries are enabled, they reduce the usable size of each 
- * thread's stack by 1 byte.
+ * thread's stack by \ref STACK_GUARD_SIZE bytes.
+ * 
+ * If \ref KERNEL_USE_STACK_POOL is defined, only \c THREAD0_STACK_SIZE is 
+ * used, and the other sizes are given to \ref kn_create_pooled_thread.
+ * 
+ * tools/stack_depth.py computes the minimum safe size for each thread from 
+ * the call graph of the linked program and the output of gcc's 
+ * \c -fstack-usage option, including room for the deepest interrupt and the 
+ * guard zone.  It fails if any size here is smaller, so it can be run after 
+ * each build; see the script's help for details.
  * 
  * @{
  */
 
 /** The size of the stack for \c THREAD0. */
-#define THREAD0_STACK_SIZE 64
+#define THREAD0_STACK_SIZE 128
 /** The size of the stack for \c THREAD1. */
-#define THREAD1_STACK_SIZE 64
+#define THREAD1_STACK_SIZE 128
 /** The size of the stack for \c THREAD2. */
-#define THREAD2_STACK_SIZE 64
+#define THREAD2_STACK_SIZE 128
 /** The size of the stack for \c THREAD3. */
 #define THREAD3_STACK_SIZE 64
 /** The size of the stack for \c THREAD4. */
@@ -0,0 +1,98 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Inline function definitions for the kernel's interrupts-disabled 
+ * sections.
+ * 
+ * \see kernel_atomic
+ */
+
+#ifndef CRITICAL_INL_H_
+#define CRITICAL_INL_H_
+
+/**
+ * \addtogroup kernel_implementation
+ * @{
+ */
+
+/** \def CRITICAL_TIMESTAMP
+ * Reads the timer used to measure critical sections.
+ */
+#ifdef CRITICAL_STATS_TIMER1
+  #define CRITICAL_TIMESTAMP() TCNT1
+#else
+  #define CRITICAL_TIMESTAMP() TCNT0
+#endif
+
+#ifdef KERNEL_USE_CRITICAL_STATS
+/** 
+ * The timer value when interrupts were last disabled by the kernel.
+ */
+extern volatile uint16_t kn_critical_start;
+
+/**
+ * True while a critical section is being timed.  Set when 
+ * \ref kn_critical_start is taken, and cleared when the section is recorded.  
+ * A section that begins with interrupts already disabled (for example, 
+ * \ref kn_wait called inside the caller's own \c ATOMIC_BLOCK) takes no start 
+ * time, and must not be recorded against an old one.
+ */
+extern volatile bool kn_critical_open;
+
+/**
+ * Ends the measurement of a critical section that began at 
+ * \ref kn_critical_start, and adds it to the statistics.  Does nothing unless 
+ * \ref kn_critical_open is set.  Must be called with interrupts disabled, 
+ * just before they are enabled again.
+ */
+extern void kn_critical_record();
+#endif
+
+/**
+ * @}
+ */
+
+uint8_t kn_critical_begin()
+{
+  uint8_t sreg = SREG;
+  cli();
+  #ifdef KERNEL_USE_CRITICAL_STATS
+  if (sreg & _BV(SREG_I))
+  {
+    kn_critical_start = CRITICAL_TIMESTAMP();
+    kn_critical_open = true;
+  }
+  #endif
+  return sreg;
+}
+
+void kn_critical_end(const uint8_t* sreg)
+{
+  #ifdef KERNEL_USE_CRITICAL_STATS
+  if (*sreg & _BV(SREG_I))
+  {
+    kn_critical_record();
+  }
+  #endif
+  SREG = *sreg;
+  __asm__ volatile ("" ::: "memory");
+}
+
+#endif
@@ -0,0 +1,98 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Implements the statistics for interrupts-disabled sections.
+ * \see kernel_implementation
+ */
+
+#include "kernel_debug.h"
+#include "config.h"
+#include "kernel_atomic.h"
+#include <avr/io.h>
+#include <string.h>
+
+#ifdef KERNEL_USE_CRITICAL_STATS
+
+volatile uint16_t kn_critical_start;
+volatile bool kn_critical_open;
+
+/** The statistics gathered so far. */
+static critical_stats kn_stats;
+
+void kn_critical_record()
+{
+  if (!kn_critical_open)
+  {
+    return;
+  }
+  kn_critical_open = false;
+  
+  #ifdef CRITICAL_STATS_TIMER1
+  // Timer1 runs freely, so the subtraction wraps correctly for any section 
+  // shorter than 65536 cycles
+  uint16_t elapsed = TCNT1 - kn_critical_start;
+  #else
+  // Timer0 is cleared on compare match every tick
+  // a pending compare match with no apparent wrap means the counter went all 
+  // the way around, but longer sections can not be measured
+  uint8_t now = TCNT0;
+  uint8_t start = (uint8_t)kn_critical_start;
+  uint16_t elapsed = (uint8_t)(now - start);
+  if ((now < start) || (TIFR0 & _BV(OCF0A)))
+  {
+    elapsed = now + (OCR0A + 1) - start;
+  }
+  #endif
+  
+  if (elapsed > kn_stats.max)
+  {
+    kn_stats.max = elapsed;
+  }
+  
+  // bucket n holds durations in the range [2^n, 2^(n+1))
+  uint8_t bucket = 0;
+  while ((elapsed > 1) && (bucket < CRITICAL_STATS_BUCKETS - 1))
+  {
+    elapsed >>= 1;
+    bucket++;
+  }
+  if (kn_stats.histogram[bucket] != UINT16_MAX)
+  {
+    kn_stats.histogram[bucket]++;
+  }
+}
+
+void kn_critical_stats(critical_stats* stats)
+{
+  kn_assert(stats != NULL);
+  
+  uint8_t sreg = kn_critical_begin();
+  memcpy(stats, &kn_stats, sizeof(kn_stats));
+  kn_critical_end(&sreg);
+}
+
+void kn_critical_stats_reset()
+{
+  uint8_t sreg = kn_critical_begin();
+  memset(&kn_stats, 0, sizeof(kn_stats));
+  kn_critical_end(&sreg);
+}
+
+#endif
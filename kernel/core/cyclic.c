@@ -0,0 +1,266 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Implements the cyclic executive.
+ * \see kernel_cyclic
+ */
+
+#include "kernel.h"
+#include "kernel_cyclic.h"
+#include "kernel_debug.h"
+#include "config.h"
+#include "kernel_atomic.h"
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#ifdef KERNEL_USE_CYCLIC
+
+#if defined(KERNEL_USE_NESTED_ISR) || defined(KERNEL_USE_IDLE_HOOK)
+  /** Defined when a slot may have to wait before its task can run. */
+  #define CYCLIC_DEFER
+#endif
+
+/**
+ * \addtogroup kernel_implementation
+ * @{
+ */
+
+/** 
+ * Set while a schedule is running, which makes every tick take the slow path 
+ * of the timer interrupt.
+ */
+volatile uint8_t kn_cyclic_active;
+
+/** The schedule table. */
+static const cyclic_task* kn_cyclic_table;
+
+/** The number of slots in the table. */
+static uint8_t kn_cyclic_slots;
+
+/** The length of each slot, in ticks. */
+static uint8_t kn_cyclic_length;
+
+/** The slot that starts when \ref kn_cyclic_countdown reaches 0. */
+static uint8_t kn_cyclic_next;
+
+/** The number of ticks until the next slot starts. */
+static uint8_t kn_cyclic_countdown;
+
+/** Set while a task is running. */
+static volatile bool kn_cyclic_busy;
+
+/** The slot of the task that is running. */
+static uint8_t kn_cyclic_running;
+
+/** The number of slots skipped because of an overrun. */
+static uint16_t kn_cyclic_overrun_count;
+
+/** The slot of the task that most recently overran. */
+static uint8_t kn_cyclic_overrun_slot;
+
+#ifdef CYCLIC_DEFER
+  /** 
+   * Set when a slot started while its task could not run: while nestable 
+   * handlers were running, or while the idle hook had the processor.
+   */
+  volatile bool kn_cyclic_deferred;
+  
+  /** The slot that was deferred. */
+  static uint8_t kn_cyclic_deferred_slot;
+#endif
+#ifdef KERNEL_USE_NESTED_ISR
+  extern volatile uint8_t kn_isr_nesting;
+#endif
+#ifdef KERNEL_USE_IDLE_HOOK
+  extern volatile bool kn_idle_active;
+#endif
+
+/**
+ * Starts the next slot when it is due.  Called by the timer interrupt with 
+ * interrupts disabled, after \ref kn_tick.  Enables interrupts while a task 
+ * runs, so that the timer interrupt can nest and detect an overrun.
+ */
+void kn_cyclic_tick();
+
+/**
+ * Runs the task of a slot, if it has one.  Called with interrupts disabled.
+ * 
+ * \param[in] slot The slot.
+ */
+static void kn_cyclic_dispatch(const uint8_t slot);
+
+#ifdef CYCLIC_DEFER
+/**
+ * Returns true if a task can not run yet.  A task must not run ahead of a 
+ * nestable handler that it interrupted, or on the idle stack, which has no 
+ * room for a task and a nested tick.
+ */
+static inline bool kn_cyclic_must_wait();
+
+/**
+ * Runs a deferred slot, unless it still has to wait.  Called with interrupts 
+ * disabled when the outermost nestable handler returns, and by the scheduler 
+ * on the current thread's stack before it calls the idle hook, unless the 
+ * current thread has been disabled and so has no saved stack.
+ */
+void kn_cyclic_run_deferred();
+#endif
+
+/**
+ * @}
+ */
+
+void kn_cyclic_tick()
+{
+  if (!kn_cyclic_active || --kn_cyclic_countdown)
+  {
+    return;
+  }
+  
+  uint8_t slot = kn_cyclic_next;
+  kn_cyclic_countdown = kn_cyclic_length;
+  if (++kn_cyclic_next == kn_cyclic_slots)
+  {
+    kn_cyclic_next = 0;
+  }
+  
+  // this tick interrupted a task that should have finished
+  if (kn_cyclic_busy)
+  {
+    if (kn_cyclic_overrun_count < UINT16_MAX)
+    {
+      kn_cyclic_overrun_count++;
+    }
+    kn_cyclic_overrun_slot = kn_cyclic_running;
+    return;
+  }
+  
+  #ifdef CYCLIC_DEFER
+  // a slot that is still waiting when the next one starts is overrun
+  if (kn_cyclic_must_wait())
+  {
+    if (kn_cyclic_deferred && (kn_cyclic_overrun_count < UINT16_MAX))
+    {
+      kn_cyclic_overrun_count++;
+      kn_cyclic_overrun_slot = kn_cyclic_deferred_slot;
+    }
+    kn_cyclic_deferred = true;
+    kn_cyclic_deferred_slot = slot;
+    return;
+  }
+  #endif
+  
+  kn_cyclic_dispatch(slot);
+}
+
+void kn_cyclic_dispatch(const uint8_t slot)
+{
+  // the table must be below 64 KB since only a pointer to it is known
+  cyclic_task task = (cyclic_task)pgm_read_word(&kn_cyclic_table[slot]);
+  if (task)
+  {
+    kn_cyclic_busy = true;
+    kn_cyclic_running = slot;
+    sei();
+    task();
+    cli();
+    kn_cyclic_busy = false;
+  }
+}
+
+#ifdef CYCLIC_DEFER
+bool kn_cyclic_must_wait()
+{
+  #ifdef KERNEL_USE_NESTED_ISR
+  if (kn_isr_nesting)
+  {
+    return true;
+  }
+  #endif
+  #ifdef KERNEL_USE_IDLE_HOOK
+  if (kn_idle_active)
+  {
+    return true;
+  }
+  #endif
+  return false;
+}
+
+void kn_cyclic_run_deferred()
+{
+  // a nestable handler may return while the idle hook has the processor
+  if (kn_cyclic_must_wait())
+  {
+    return;
+  }
+  
+  kn_cyclic_deferred = false;
+  if (kn_cyclic_active)
+  {
+    kn_cyclic_dispatch(kn_cyclic_deferred_slot);
+  }
+}
+#endif
+
+void kn_cyclic_start(const cyclic_task* table, const uint8_t slots,
+                     const uint8_t slot_length)
+{
+  kn_assert(table != NULL);
+  kn_assert(slots > 0);
+  kn_assert(slot_length > 0);
+  
+  KN_ATOMIC_BLOCK
+  {
+    kn_cyclic_table = table;
+    kn_cyclic_slots = slots;
+    kn_cyclic_length = slot_length;
+    kn_cyclic_next = 0;
+    kn_cyclic_countdown = 1;
+    kn_cyclic_overrun_count = 0;
+    kn_cyclic_overrun_slot = 0;
+    #ifdef CYCLIC_DEFER
+    kn_cyclic_deferred = false;
+    #endif
+    kn_cyclic_active = true;
+  }
+}
+
+void kn_cyclic_stop()
+{
+  kn_cyclic_active = false;
+}
+
+uint16_t kn_cyclic_overruns(uint8_t* slot)
+{
+  uint16_t count;
+  
+  KN_ATOMIC_BLOCK
+  {
+    count = kn_cyclic_overrun_count;
+    if (slot)
+    {
+      *slot = kn_cyclic_overrun_slot;
+    }
+  }
+  
+  return count;
+}
+
+#endif
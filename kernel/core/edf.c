@@ -0,0 +1,203 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Implements earliest deadline first scheduling.
+ * \see kernel_edf
+ */
+
+#include "kernel.h"
+#include "kernel_edf.h"
+#include "kernel_debug.h"
+#include "config.h"
+#include "kernel_atomic.h"
+#include "util.h"
+
+#ifdef KERNEL_USE_EDF
+
+/**
+ * \addtogroup kernel_implementation
+ * @{
+ */
+
+/**
+ * The timing of a periodic thread.  Absolute times are the low 16 bits of 
+ * \ref kn_system_counter, and are compared with wrapping arithmetic.
+ */
+typedef struct
+{
+  /** The time between releases. */
+  uint16_t period;
+  /** The deadline relative to each release. */
+  uint16_t deadline;
+  /** The worst case execution time of a job. */
+  uint16_t wcet;
+  /** The release time of the current job. */
+  uint16_t release;
+  /** The absolute deadline of the current job. */
+  uint16_t abs_deadline;
+  /** The number of missed deadlines. */
+  uint16_t misses;
+} edf_thread;
+
+/** The timing of each periodic thread. */
+static edf_thread kn_edf[MAX_THREADS];
+
+extern thread_id kn_cur_thread;
+extern uint8_t kn_disabled_threads;
+extern uint8_t kn_periodic_threads;
+extern uint8_t kn_edf_pending;
+extern volatile uint32_t kn_system_counter;
+
+/**
+ * Selects the ready periodic thread with the earliest deadline.  Called by 
+ * the scheduler with interrupts disabled.
+ * 
+ * \param[in] not_ready The mask of threads that cannot run.
+ * 
+ * \return The thread id in the low byte and its mask in the high byte, or 0 
+ * if no periodic thread is ready.
+ */
+uint16_t kn_edf_select(const uint8_t not_ready);
+
+/**
+ * @}
+ */
+
+uint16_t kn_edf_select(const uint8_t not_ready)
+{
+  uint8_t ready = kn_periodic_threads & ~not_ready;
+  if (!ready)
+  {
+    return 0;
+  }
+  
+  uint8_t best = 0;
+  uint8_t best_mask = 0;
+  uint8_t mask = 0x01;
+  
+  for (uint8_t i = 0; i < MAX_THREADS; i++, mask <<= 1)
+  {
+    if ((ready & mask) && (!best_mask || 
+      (int16_t)(kn_edf[i].abs_deadline - kn_edf[best].abs_deadline) < 0))
+    {
+      best = i;
+      best_mask = mask;
+    }
+  }
+  
+  return ((uint16_t)best_mask << 8) | best;
+}
+
+bool kn_create_periodic_thread(const thread_id t_id, thread_ptr entry_point, 
+                               const bool suspended, void* arg,
+                               const uint16_t period, const uint16_t deadline,
+                               const uint16_t wcet)
+{
+  kn_assert(t_id < MAX_THREADS);
+  kn_assert(period > 0 && period <= INT16_MAX);
+  kn_assert(deadline > 0 && deadline <= period);
+  kn_assert(wcet > 0 && wcet <= deadline);
+  
+  // sum the load of the other periodic threads in 1/65536 units, along with 
+  // the new one
+  uint8_t others = kn_periodic_threads & ~kn_disabled_threads & 
+    ~bit_to_mask(t_id);
+  uint32_t load = ((uint32_t)wcet << 16) / deadline;
+  
+  for (uint8_t i = 0; i < MAX_THREADS; i++)
+  {
+    if (others & bit_to_mask(i))
+    {
+      load += ((uint32_t)kn_edf[i].wcet << 16) / kn_edf[i].deadline;
+    }
+  }
+  
+  if (load > 0x10000UL)
+  {
+    return false;
+  }
+  
+  KN_ATOMIC_BLOCK
+  {
+    edf_thread* thread = &kn_edf[t_id];
+    thread->period = period;
+    thread->deadline = deadline;
+    thread->wcet = wcet;
+    thread->release = (uint16_t)kn_system_counter;
+    thread->abs_deadline = thread->release + deadline;
+    thread->misses = 0;
+    // marks the thread as periodic when it is created
+    kn_edf_pending = bit_to_mask(t_id);
+    
+    kn_create_thread(t_id, entry_point, suspended, arg);
+  }
+  
+  return true;
+}
+
+void kn_wait_next_period()
+{
+  thread_id t_id = kn_cur_thread;
+  edf_thread* thread = &kn_edf[t_id];
+  
+  kn_assert(kn_periodic_threads & bit_to_mask(t_id));
+  
+  KN_ATOMIC_BLOCK
+  {
+    uint16_t now = (uint16_t)kn_system_counter;
+    
+    if ((int16_t)(now - thread->abs_deadline) > 0 && 
+      thread->misses < UINT16_MAX)
+    {
+      thread->misses++;
+    }
+    
+    thread->release += thread->period;
+    thread->abs_deadline = thread->release + thread->deadline;
+    
+    // sleeping with interrupts disabled keeps a tick from landing between 
+    // reading the time and starting the sleep
+    int16_t delay = thread->release - now;
+    if (delay > 0)
+    {
+      kn_sleep(delay);
+    }
+    else
+    {
+      kn_yield();
+    }
+  }
+}
+
+uint16_t kn_deadline_misses(const thread_id t_id)
+{
+  kn_assert(t_id < MAX_THREADS);
+  
+  uint16_t misses;
+  
+  KN_ATOMIC_BLOCK
+  {
+    misses = kn_edf[t_id].misses;
+  }
+  
+  return misses;
+}
+
+#endif /* KERNEL_USE_EDF */
@@ -0,0 +1,67 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Inline function definitions for nested interrupts.
+ * 
+ * \see kernel_isr
+ */
+
+#ifndef ISR_INL_H_
+#define ISR_INL_H_
+
+void kn_isr_nest()
+{
+  sei();
+}
+
+uint8_t kn_isr_depth()
+{
+  extern volatile uint8_t kn_isr_nesting;
+  return kn_isr_nesting;
+}
+
+void kn_isr_enter()
+{
+  extern volatile uint8_t kn_isr_nesting;
+  // interrupts are still disabled
+  kn_isr_nesting++;
+}
+
+void kn_isr_exit()
+{
+  extern volatile uint8_t kn_isr_nesting;
+  
+  cli();
+  if (--kn_isr_nesting == 0)
+  {
+    #ifdef KERNEL_USE_CYCLIC
+    extern volatile bool kn_cyclic_deferred;
+    extern void kn_cyclic_run_deferred();
+    
+    // a slot that started while handlers were nested
+    if (kn_cyclic_deferred)
+    {
+      kn_cyclic_run_deferred();
+    }
+    #endif
+  }
+}
+
+#endif /* ISR_INL_H_ */
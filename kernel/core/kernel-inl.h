@@ -46,7 +46,7 @@ thread_id kn_current_thread()
 
 void kn_disable_self()
 {
-  extern thread_id kn_cur_thread_mask;
+  extern uint8_t kn_cur_thread_mask;
   extern uint8_t kn_disabled_threads;
   extern void kn_scheduler();
   
@@ -56,7 +56,7 @@ void kn_disable_self()
 
 void kn_suspend_self()
 {
-  extern thread_id kn_cur_thread_mask;
+  extern uint8_t kn_cur_thread_mask;
   extern uint8_t kn_suspended_threads;
   
   kn_suspended_threads |= kn_cur_thread_mask;
@@ -24,12 +24,13 @@
 
 #include "kernel.h"
 #include "kernel_debug.h"
+#include "kernel_seqlock.h"
 #include "config.h"
 #include "stacks.h"
+#include "kernel_atomic.h"
 #include "util.h"
 #include <avr/io.h>
 #include <avr/pgmspace.h>
-#include <util/atomic.h>
 #include <avr/interrupt.h>
 
 /**
@@ -39,6 +40,9 @@
  * @{
  */
 
+/** Passed to \ref kn_block to yield instead of switching to a thread. */
+#define NO_THREAD 0xFF
+
 /**
  * Bitmasks used for converting a thread id to a thread mask.
  */
@@ -50,63 +54,132 @@ const uint8_t kn_bitmasks[8] PROGMEM = {
  * Local stack info
  *****************************************************************************/
 
-/**
- * Contains pointers to the base of each stack for easier run time access.
- */
-const uint8_t* const kn_stack_base[MAX_THREADS] PROGMEM = {
-  THREAD0_STACK_BASE
-  #if MAX_THREADS >= 2
-    , THREAD1_STACK_BASE
-  #endif
-  #if MAX_THREADS >= 3
-    , THREAD2_STACK_BASE
-  #endif
-  #if MAX_THREADS >= 4
-    , THREAD3_STACK_BASE
-  #endif
-  #if MAX_THREADS >= 5
-    , THREAD4_STACK_BASE
-  #endif
-  #if MAX_THREADS >= 6
-    , THREAD5_STACK_BASE
-  #endif
-  #if MAX_THREADS >= 7
-    , THREAD6_STACK_BASE
-  #endif
-  #if MAX_THREADS == 8
-    , THREAD7_STACK_BASE
+#ifdef KERNEL_USE_STACK_POOL
+  /**
+   * Contains pointers to the base of each stack, which are set when a stack 
+   * is allocated from the pool.
+   */
+  uint8_t* kn_stack_base[MAX_THREADS];
+  
+  /**
+   * Contains pointers to the lowest byte of each stack, which is the bottom of 
+   * its guard zone.
+   */
+  uint8_t* kn_stack_end[MAX_THREADS];
+  
+  #ifdef KERNEL_USE_STACK_CHECK
+    /**
+     * Contains the lowest valid stack pointer value for each stack, for 
+     * checking the stack pointer at run time.
+     */
+    uint8_t* kn_stack_limit[MAX_THREADS];
   #endif
-};
-
-#ifdef KERNEL_USE_STACK_CANARY
+  
+  /** 
+   * Tracks threads that own a stack in the pool.  The stack of a disabled 
+   * thread is free, and is reclaimed by the next allocation.
+   */
+  static uint8_t kn_pool_threads;
+  
+  /** The guard zone pointers are the bottom of each stack. */
+  #define kn_canary_loc kn_stack_end
+  
+  /** Reads a pointer from one of the stack tables. */
+  #define read_stack_table(table, index) ((table)[index])
+#else
   /**
-   * Contains pointers to each stack's canary location for easier run time 
-   * access.
+   * Contains pointers to the base of each stack for easier run time access.
    */
-  const uint8_t* const kn_canary_loc[MAX_THREADS] PROGMEM = {
-    THREAD0_CANARY_LOC
+  const uint8_t* const kn_stack_base[MAX_THREADS] PROGMEM = {
+    THREAD0_STACK_BASE
     #if MAX_THREADS >= 2
-    , THREAD1_CANARY_LOC
+      , THREAD1_STACK_BASE
     #endif
     #if MAX_THREADS >= 3
-    , THREAD2_CANARY_LOC
+      , THREAD2_STACK_BASE
     #endif
     #if MAX_THREADS >= 4
-    , THREAD3_CANARY_LOC
+      , THREAD3_STACK_BASE
     #endif
     #if MAX_THREADS >= 5
-    , THREAD4_CANARY_LOC
+      , THREAD4_STACK_BASE
     #endif
     #if MAX_THREADS >= 6
-    , THREAD5_CANARY_LOC
+      , THREAD5_STACK_BASE
     #endif
     #if MAX_THREADS >= 7
-    , THREAD6_CANARY_LOC
+      , THREAD6_STACK_BASE
     #endif
     #if MAX_THREADS == 8
-    , THREAD7_CANARY_LOC
+      , THREAD7_STACK_BASE
     #endif
   };
+
+  #ifdef KERNEL_USE_STACK_CHECK
+    /**
+     * Contains the lowest valid stack pointer value for each stack, for checking 
+     * the stack pointer at run time.
+     */
+    const uint8_t* const kn_stack_limit[MAX_THREADS] PROGMEM = {
+      THREAD0_STACK_LIMIT
+      #if MAX_THREADS >= 2
+      , THREAD1_STACK_LIMIT
+      #endif
+      #if MAX_THREADS >= 3
+      , THREAD2_STACK_LIMIT
+      #endif
+      #if MAX_THREADS >= 4
+      , THREAD3_STACK_LIMIT
+      #endif
+      #if MAX_THREADS >= 5
+      , THREAD4_STACK_LIMIT
+      #endif
+      #if MAX_THREADS >= 6
+      , THREAD5_STACK_LIMIT
+      #endif
+      #if MAX_THREADS >= 7
+      , THREAD6_STACK_LIMIT
+      #endif
+      #if MAX_THREADS == 8
+      , THREAD7_STACK_LIMIT
+      #endif
+    };
+  #endif
+
+  #ifdef KERNEL_USE_STACK_CANARY
+    /**
+     * Contains pointers to the bottom of each stack's guard zone for easier run 
+     * time access.
+     */
+    const uint8_t* const kn_canary_loc[MAX_THREADS] PROGMEM = {
+      THREAD0_CANARY_LOC
+      #if MAX_THREADS >= 2
+      , THREAD1_CANARY_LOC
+      #endif
+      #if MAX_THREADS >= 3
+      , THREAD2_CANARY_LOC
+      #endif
+      #if MAX_THREADS >= 4
+      , THREAD3_CANARY_LOC
+      #endif
+      #if MAX_THREADS >= 5
+      , THREAD4_CANARY_LOC
+      #endif
+      #if MAX_THREADS >= 6
+      , THREAD5_CANARY_LOC
+      #endif
+      #if MAX_THREADS >= 7
+      , THREAD6_CANARY_LOC
+      #endif
+      #if MAX_THREADS == 8
+      , THREAD7_CANARY_LOC
+      #endif
+    };
+  #endif
+  
+  /** Reads a pointer from one of the stack tables. */
+  #define read_stack_table(table, index) \
+    ((uint8_t*)read_pm_word(table, index))
 #endif
 
 /******************************************************************************
@@ -128,15 +201,114 @@ uint8_t kn_suspended_threads;
 /** Tracks threads that are sleeping for some time. */
 volatile uint8_t kn_sleeping_threads;
 
+/** 
+ * Tracks threads that are blocked on a \ref wait_list.  A blocked thread 
+ * with a timeout is also marked as sleeping, and expiry of the sleep ends the 
+ * wait.
+ */
+volatile uint8_t kn_blocked_threads;
+
+/** 
+ * Tracks threads whose last wait was ended by a signal rather than a timeout. 
+ * Cleared when a thread starts to wait.
+ */
+static volatile uint8_t kn_signaled_threads;
+
+/** The threads waiting in \ref kn_suspend_timeout for \ref kn_resume. */
+static wait_list kn_resume_waiters;
+
+#ifdef KERNEL_USE_EDF
+  /** Tracks threads that are scheduled by deadline. */
+  uint8_t kn_periodic_threads;
+  
+  /** 
+   * The thread that \ref kn_create_periodic_thread is creating, which is 
+   * marked as periodic by \ref kn_create_thread_impl.
+   */
+  uint8_t kn_edf_pending;
+#endif
+
 /** Holds the saved stack locations for each thread. */
 uint8_t* kn_stack[MAX_THREADS];
 
 /** Tracks the sleep times for each thread. */
 static volatile uint16_t kn_sleep_counter[MAX_THREADS];
   
+/** The notification word of each thread. */
+static volatile uint16_t kn_notify_value[MAX_THREADS];
+
+/** The threads waiting in \ref kn_notify_wait. */
+static wait_list kn_notify_waiters;
+
+#ifdef KERNEL_USE_MESSAGES
+  /** 
+   * The message of each sending thread, which \ref kn_reply replaces with the 
+   * reply.
+   */
+  static void* kn_msg[MAX_THREADS];
+  
+  /** The senders whose messages each thread has yet to receive. */
+  static uint8_t kn_msg_pending[MAX_THREADS];
+  
+  /** The threads waiting in \ref kn_receive. */
+  static wait_list kn_receive_waiters;
+  
+  /** The threads waiting in \ref kn_send for a reply. */
+  static wait_list kn_reply_waiters;
+#endif
+
+#ifdef KERNEL_USE_NESTED_ISR
+  /** The number of nestable interrupt handlers that are running. */
+  volatile uint8_t kn_isr_nesting;
+#endif
+
+#ifdef KERNEL_USE_HOG_DETECT
+  // the timer interrupt compares the count with HOG_BUDGET + 1, and the count 
+  // stops at UINT16_MAX
+  #if defined(HOG_BUDGET) && ((HOG_BUDGET < 1) || (HOG_BUDGET > 32767))
+    #error "HOG_BUDGET must be in the range [1,32767]"
+  #endif
+  
+  /** 
+   * Set by the scheduler while a thread is running, and cleared while the 
+   * scheduler itself runs.
+   */
+  volatile uint8_t kn_run_active;
+  
+  /** 
+   * The number of ticks since the running thread was switched in.  Counted 
+   * by the timer interrupt in kernel_asm.s.
+   */
+  volatile uint16_t kn_run_ticks;
+  
+  /** The longest run of each thread, in ticks. */
+  static uint16_t kn_run_max[MAX_THREADS];
+#endif
+
 /** Counts the total system uptime, in milliseconds. */
 volatile uint32_t kn_system_counter;
 
+/** 
+ * Protects \ref kn_system_counter.  Incremented by the timer interrupt 
+ * before and after it updates the counter.
+ */
+seqlock kn_system_seq;
+
+#ifdef KERNEL_USE_IDLE_HOOK
+  /** The function called by the scheduler when no thread is ready. */
+  idle_hook_ptr kn_idle_hook;
+  
+  /** The stack that the idle hook runs on. */
+  uint8_t kn_idle_stack[IDLE_STACK_SIZE];
+  
+  /** 
+   * True while the stack pointer is on the idle stack rather than the stack 
+   * of \ref kn_cur_thread.  Set when the idle hook is first called, and 
+   * cleared when the scheduler switches back to a thread.
+   */
+  volatile bool kn_idle_active;
+#endif
+
 /******************************************************************************
  * External assembly functions
  *****************************************************************************/
@@ -157,6 +329,15 @@ extern void kn_thread_bootstrap();
  */
 extern void kn_scheduler();
 
+/**
+ * Saves the state of the calling thread like \ref kn_yield, then switches 
+ * directly to another thread without running the scheduler.  The target must 
+ * be ready to run.  Must be called with interrupts disabled.
+ * 
+ * \param[in] t_id The thread to run.
+ */
+extern void kn_switch_to(const thread_id t_id);
+
 /******************************************************************************
  * Local function declarations
  *****************************************************************************/
@@ -187,6 +368,101 @@ extern void kn_create_thread_impl(const thread_id t_id, thread_ptr entry_point,
  */
 static void kn_init() __attribute__((naked, section(".init8"), used));
 
+/**
+ * Writes a return address to a stack frame that is being built, in the same 
+ * byte order as a \c call instruction.  On MCUs with a 3 byte program counter 
+ * the high byte is taken from \c EIND: function pointers are 16 bit word 
+ * addresses, and the linker routes any target beyond 128 KB through a stub in 
+ * the segment selected by \c EIND, just as it does for \c eicall.
+ * 
+ * \param[in] sp The next free location in the stack frame.
+ * \param[in] addr The function address, as a function pointer value.
+ * 
+ * \return The next free location after the address has been written.
+ */
+static inline uint8_t* kn_push_return_addr(uint8_t* sp, const uint16_t addr);
+
+/**
+ * The exit trampoline for threads.  Its address is placed beneath the entry 
+ * point when a thread's stack is set up, so that a thread function which 
+ * returns lands here and the thread is disabled cleanly.
+ * 
+ * \see thread_ptr
+ */
+static void kn_thread_exit();
+
+#ifdef KERNEL_USE_STACK_CANARY
+/**
+ * Writes the canary values to a guard zone.
+ * 
+ * \param[in] canary The bottom of the guard zone.
+ */
+static inline void kn_fill_guard_zone(uint8_t* canary);
+#endif
+
+#ifdef KERNEL_USE_STACK_POOL
+/**
+ * Finds the highest block of the stack pool that is large enough for a stack. 
+ * Stacks of disabled threads are returned to the pool first.
+ * 
+ * \param[in] size The size of the stack.
+ * 
+ * \return The base of the block, or \c NULL if the pool has no room.
+ */
+static uint8_t* kn_pool_alloc(const uint16_t size);
+#endif
+
+/**
+ * Implements \ref kn_wait, with the option of switching directly to a thread 
+ * that is known to be ready instead of running the scheduler.
+ * 
+ * \param[in] list The wait list to block on.
+ * \param[in] timeout The maximum time to wait.
+ * \param[in] next The thread to switch to, or \ref NO_THREAD to yield.
+ */
+static bool kn_block(wait_list* list, const uint16_t timeout, 
+                     const uint8_t next);
+
+#ifdef KERNEL_USE_MESSAGES
+/**
+ * Returns true if a thread is ready to run, other than being the current 
+ * thread.  Must be called with interrupts disabled.
+ */
+static inline bool kn_thread_ready(const uint8_t mask);
+#endif
+
+/**
+ * Ends the wait of every blocked thread in \c mask, along with any timeout 
+ * the threads were waiting with.  Must be called with interrupts disabled.
+ * 
+ * \param[in] mask The threads to unblock.
+ */
+static inline void kn_unblock(const uint8_t mask);
+
+/**
+ * Ends the wait of every blocked thread in \c mask, and records that the 
+ * threads were signaled.  Must be called with interrupts disabled.
+ * 
+ * \param[in] mask The threads to signal.
+ */
+static inline void kn_unblock_signaled(const uint8_t mask);
+
+/**
+ * Counts down the sleep time of each sleeping thread, and wakes the threads 
+ * whose time has expired.  Called by the timer interrupt in kernel_asm.s, 
+ * which handles ticks with no sleeping threads by itself.
+ */
+void kn_tick();
+
+#ifdef KERNEL_USE_HOG_DETECT
+/**
+ * Keeps the length of the current thread's run, if it is the longest so far. 
+ * Called by the scheduler after it clears \ref kn_run_active, so the count no 
+ * longer changes.
+ */
+void kn_run_record();
+#endif
+
 /**
  * @}
  */
@@ -195,40 +471,229 @@ static void kn_init() __attribute__((naked, section(".init8"), used));
  * Local function definitions
  *****************************************************************************/
 
+uint8_t* kn_push_return_addr(uint8_t* sp, const uint16_t addr)
+{
+  *sp-- = addr & 0x00FF;
+  *sp-- = addr >> 8;
+  #ifdef __AVR_3_BYTE_PC__
+  *sp-- = EIND;
+  #endif
+  return sp;
+}
+
+#ifdef KERNEL_USE_STACK_CANARY
+void kn_fill_guard_zone(uint8_t* canary)
+{
+  for (uint8_t i = 0; i < STACK_GUARD_SIZE; i++)
+  {
+    canary[i] = STACK_CANARY;
+  }
+}
+#endif
+
+#ifdef KERNEL_USE_STACK_POOL
+uint8_t* kn_pool_alloc(const uint16_t size)
+{
+  kn_pool_threads &= ~kn_disabled_threads;
+  
+  // first fit from the top of the pool: a candidate block that overlaps an 
+  // allocated stack can only fit below it, so move there and test again
+  uint8_t* base = STACK_POOL_TOP;
+  bool moved;
+  do
+  {
+    if (base - STACK_POOL_BOTTOM + 1 < (int16_t)size)
+    {
+      return NULL;
+    }
+    
+    uint8_t* end = base - size + 1;
+    moved = false;
+    for (uint8_t i = THREAD1; i < MAX_THREADS; i++)
+    {
+      if ((kn_pool_threads & bit_to_mask(i)) && 
+        (end <= kn_stack_base[i]) && (base >= kn_stack_end[i]))
+      {
+        base = kn_stack_end[i] - 1;
+        moved = true;
+        break;
+      }
+    }
+  } while (moved);
+  
+  return base;
+}
+#endif
+
+void kn_unblock(const uint8_t mask)
+{
+  kn_blocked_threads &= ~mask;
+  kn_sleeping_threads &= ~mask;
+}
+
+void kn_unblock_signaled(const uint8_t mask)
+{
+  kn_signaled_threads |= mask;
+  kn_unblock(mask);
+}
+
+bool kn_block(wait_list* list, const uint16_t timeout, const uint8_t next)
+{
+  #ifdef KERNEL_USE_NESTED_ISR
+  kn_assert(kn_isr_nesting == 0);
+  #endif
+  #ifdef KERNEL_USE_IDLE_HOOK
+  kn_assert(!kn_idle_active);
+  #endif
+  
+  thread_id t_id = kn_cur_thread;
+  uint8_t mask = kn_cur_thread_mask;
+  
+  // not an atomic block: the caller's interrupt state has to be restored 
+  // after the yield, which always returns with interrupts enabled
+  uint8_t sreg = kn_critical_begin();
+  *list |= mask;
+  kn_blocked_threads |= mask;
+  kn_signaled_threads &= ~mask;
+  if (timeout != KN_WAIT_FOREVER)
+  {
+    kn_sleep_counter[t_id] = timeout;
+    kn_sleeping_threads |= mask;
+  }
+  
+  if (next == NO_THREAD)
+  {
+    kn_yield();
+  }
+  else
+  {
+    kn_switch_to(next);
+  }
+  
+  // the list can't tell a signal from a timeout: a signal that arrives after 
+  // the timeout expired finds the thread no longer blocked and passes it by
+  kn_critical_begin();
+  bool signaled = (kn_signaled_threads & mask) != 0;
+  *list &= ~mask;
+  kn_critical_end(&sreg);
+  
+  return signaled;
+}
+
+#ifdef KERNEL_USE_MESSAGES
+bool kn_thread_ready(const uint8_t mask)
+{
+  return !((kn_disabled_threads | kn_suspended_threads | kn_sleeping_threads | 
+    kn_blocked_threads) & mask);
+}
+#endif
+
+void kn_tick()
+{
+  #if defined(KERNEL_USE_HOG_DETECT) && defined(HOG_BUDGET)
+  // the interrupt has already counted this tick, and takes the slow path on 
+  // the tick that goes over the budget
+  if (kn_run_active && (kn_run_ticks == HOG_BUDGET + 1))
+  {
+    kn_thread_hog(kn_cur_thread);
+  }
+  #endif
+  
+  // grab a local copy of the sleep state to avoid a read every time it is used
+  uint8_t sleeping = kn_sleeping_threads;  
+  uint8_t expired = 0x00;
+  thread_id t_id = THREAD0;
+  uint8_t mask = 0x01;
+  
+  // sleeping will be 0 when no more sleeping threads are left to check
+  while (sleeping && (t_id < MAX_THREADS))
+  {
+    // see if this thread is sleeping
+    if (sleeping & mask)
+    {
+      sleeping &= ~mask;
+      if (--kn_sleep_counter[t_id] == 0)
+      {
+        expired |= mask;
+      }
+    }
+    
+    t_id++;
+    mask <<= 1;
+  }
+  
+  // a thread that was waiting with a timeout stops waiting when it expires
+  kn_sleeping_threads &= ~expired;
+  kn_blocked_threads &= ~expired;
+}
+
+#ifdef KERNEL_USE_HOG_DETECT
+void kn_run_record()
+{
+  if (kn_run_ticks > kn_run_max[kn_cur_thread])
+  {
+    kn_run_max[kn_cur_thread] = kn_run_ticks;
+  }
+}
+#endif
+
+void kn_thread_exit()
+{
+  kn_disable_self();
+}
+
 void kn_create_thread_impl(const thread_id t_id, thread_ptr entry_point, 
                            const bool suspended, void* arg)
 {
   kn_assert(t_id < MAX_THREADS);
   kn_assert(entry_point != NULL);
+  #ifdef KERNEL_USE_STACK_POOL
+  kn_assert(t_id == THREAD0 || (kn_pool_threads & bit_to_mask(t_id)));
+  #endif
   
   // set the initial state of the thread's stack
   // the stack is set up so that the scheduler "returns" to the bootstrap 
   // function as if it had yielded
   // the bootstrap function then loads the thread args into the correct 
   // registers and jumps to the new thread
-  kn_stack[t_id] = ((uint8_t*)pgm_read_word(&kn_stack_base[t_id])) -
-    INITIAL_STACK_USAGE;  
-  // 2 bytes for the entry point address
-  kn_stack[t_id][25] = ((uint16_t)entry_point) & 0x00FF;
-  kn_stack[t_id][24] = ((uint16_t)entry_point) >> 8;
+  // the frame is built downward from the stack base in the same order that 
+  // call and push would have written it
+  uint8_t* sp = read_stack_table(kn_stack_base, t_id);
+  // the entry point "returns" to the exit trampoline
+  sp = kn_push_return_addr(sp, (uint16_t)kn_thread_exit);
+  // entry point address
+  sp = kn_push_return_addr(sp, (uint16_t)entry_point);
   // 2 bytes for arg
-  kn_stack[t_id][23] = ((uint16_t)arg) & 0x00FF;
-  kn_stack[t_id][22] = ((uint16_t)arg) >> 8;
+  *sp-- = ((uint16_t)arg) & 0x00FF;
+  *sp-- = ((uint16_t)arg) >> 8;
   // 1 byte for the thread id
-  kn_stack[t_id][21] = t_id;
-  // 2 bytes for the bootstrap address
-  kn_stack[t_id][20] = ((uint16_t)kn_thread_bootstrap) & 0x00FF;
-  kn_stack[t_id][19] = ((uint16_t)kn_thread_bootstrap) >> 8;
+  *sp-- = t_id;
+  // bootstrap address
+  sp = kn_push_return_addr(sp, (uint16_t)kn_thread_bootstrap);
   // the remaining 18 bytes are popped to restore registers
   // their value doesn't actually matter they just need to be on the stack
+  kn_stack[t_id] = sp - 18;
   
   // update kernel state for the new thread
   uint8_t mask = bit_to_mask(t_id);
   kn_disabled_threads &= ~mask;
   kn_sleeping_threads &= ~mask;
+  kn_blocked_threads &= ~mask;
   kn_suspended_threads = 
     suspended ? (kn_suspended_threads | mask) : (kn_suspended_threads & ~mask);
   kn_sleep_counter[t_id] = 0;
+  kn_notify_value[t_id] = 0;
+  kn_notify_waiters &= ~mask;
+  #ifdef KERNEL_USE_HOG_DETECT
+  kn_run_max[t_id] = 0;
+  #endif
+  #ifdef KERNEL_USE_MESSAGES
+  kn_msg_pending[t_id] = 0;
+  #endif
+  #ifdef KERNEL_USE_EDF
+  kn_periodic_threads = (kn_periodic_threads & ~mask) | (kn_edf_pending & mask);
+  kn_edf_pending = 0;
+  #endif
   
   if (t_id == kn_cur_thread)
   {
@@ -238,15 +703,32 @@ void kn_create_thread_impl(const thread_id t_id, thread_ptr entry_point,
 
 void kn_init()
 {
+  #ifdef KERNEL_USE_STACK_POOL
+  // only THREAD0 has a stack until the others are allocated from the pool
+  kn_stack_base[THREAD0] = THREAD0_STACK_BASE;
+  kn_stack_end[THREAD0] = THREAD0_STACK_BASE - THREAD0_STACK_SIZE + 1;
+  #ifdef KERNEL_USE_STACK_CHECK
+  kn_stack_limit[THREAD0] = THREAD0_STACK_LIMIT;
+  #endif
+  kn_pool_threads = 0x00;
+  #endif
+  
   // initialize each thread's state
   for (uint8_t i = 0; i < MAX_THREADS; i++)
   {
-    kn_stack[i] = (uint8_t*)pgm_read_word(&kn_stack_base[i]);
+    kn_stack[i] = read_stack_table(kn_stack_base, i);
     kn_sleep_counter[i] = 0;
+    kn_notify_value[i] = 0;
+    #ifdef KERNEL_USE_HOG_DETECT
+    kn_run_max[i] = 0;
+    #endif
 
     #ifdef KERNEL_USE_STACK_CANARY
-    uint8_t* canary = (uint8_t*)pgm_read_word(&kn_canary_loc[i]);
-    *canary = STACK_CANARY;
+    // pooled stacks get their guard zone when they are allocated
+    if (i < STATIC_THREADS)
+    {
+      kn_fill_guard_zone(read_stack_table(kn_canary_loc, i));
+    }
     #endif
   }
   
@@ -259,28 +741,63 @@ void kn_init()
   kn_suspended_threads = 0x00;
   // no threads delayed
   kn_sleeping_threads = 0x00;
+  // no threads blocked
+  kn_blocked_threads = 0x00;
+  kn_resume_waiters = 0x00;
+  kn_signaled_threads = 0x00;
+  kn_notify_waiters = 0x00;
+  #ifdef KERNEL_USE_MESSAGES
+  kn_receive_waiters = 0x00;
+  kn_reply_waiters = 0x00;
+  #endif
+  #ifdef KERNEL_USE_EDF
+  kn_periodic_threads = 0x00;
+  kn_edf_pending = 0x00;
+  #endif
+  
+  #ifdef KERNEL_USE_NESTED_ISR
+  kn_isr_nesting = 0;
+  #endif
+  #ifdef KERNEL_USE_HOG_DETECT
+  // THREAD0 is already running
+  kn_run_active = true;
+  kn_run_ticks = 0;
+  #endif
+  
+  #ifdef KERNEL_USE_IDLE_HOOK
+  kn_idle_hook = NULL;
+  kn_idle_active = false;
+  #endif
   // set the stack for THREAD0
   SP = (uint16_t)kn_stack[THREAD0];
   
   // reset system counter
   kn_system_counter = 0;
+  kn_system_seq = 0;
   
 #if !defined(F_CPU) || F_CPU != 16000000
   #error "CPU clock speed not expected value."
 #endif
 
   // 1ms tick rate means we need a tick every 16000 clock cycles
-  // using a prescaler of 64 gives a tick when timer0 == 250
+  // using a prescaler of 64 gives a tick every 250 timer counts, and the 
+  // counter runs from 0 to OCR0A inclusive
   
   // WGM mode 2 (clear timer on compare match)
   TCCR0A |= 0x02;
   // clock source = clock / 64
   TCCR0B |= 0x03;
   // timer output compare
-  OCR0A = 250;
+  OCR0A = 249;
   // enable interrupt when OCR0A is matched
   TIMSK0 |= 0x02;
   
+  #if defined(KERNEL_USE_CRITICAL_STATS) && defined(CRITICAL_STATS_TIMER1)
+  // Timer1 runs freely from the CPU clock to time critical sections
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  #endif
+  
   // sleep mode idle, sleep disabled
   SMCR = 0;
 }
@@ -289,12 +806,65 @@ void kn_init()
  * External function definitions
  *****************************************************************************/
 
+#ifdef KERNEL_USE_STACK_POOL
+bool kn_create_pooled_thread(const thread_id t_id, thread_ptr entry_point, 
+                             const bool suspended, void* arg, 
+                             const uint16_t stack_size)
+{
+  kn_assert(t_id != THREAD0 && t_id < MAX_THREADS);
+  kn_assert(t_id != kn_cur_thread);
+  kn_assert(stack_size >= MIN_STACK_SIZE);
+  
+  uint8_t mask = bit_to_mask(t_id);
+  
+  // a thread that is being replaced gives up its stack, unless the pool has 
+  // no room for the new one
+  uint8_t owned = kn_pool_threads & mask;
+  kn_pool_threads &= ~mask;
+  uint8_t* base = kn_pool_alloc(stack_size);
+  if (base == NULL)
+  {
+    kn_pool_threads |= owned;
+    return false;
+  }
+  
+  // the tick only checks the bounds of the running thread, so the tables can 
+  // be changed with interrupts enabled
+  kn_stack_base[t_id] = base;
+  kn_stack_end[t_id] = base - stack_size + 1;
+  #ifdef KERNEL_USE_STACK_CHECK
+  kn_stack_limit[t_id] = kn_stack_end[t_id] + GUARD_ZONE_SIZE - 1;
+  #endif
+  #ifdef KERNEL_USE_STACK_CANARY
+  kn_fill_guard_zone(kn_stack_end[t_id]);
+  #endif
+  kn_pool_threads |= mask;
+  
+  kn_create_thread(t_id, entry_point, suspended, arg);
+  return true;
+}
+#endif
+
+#ifdef KERNEL_USE_IDLE_HOOK
+void kn_set_idle_hook(idle_hook_ptr hook)
+{
+  kn_idle_hook = hook;
+}
+#endif
+
 void kn_sleep(const uint16_t millis)
 {
+  #ifdef KERNEL_USE_NESTED_ISR
+  kn_assert(kn_isr_nesting == 0);
+  #endif
+  #ifdef KERNEL_USE_IDLE_HOOK
+  kn_assert(!kn_idle_active);
+  #endif
+  
   thread_id t_id = kn_cur_thread;
   uint8_t mask = bit_to_mask(t_id);
   
-  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  KN_ATOMIC_BLOCK
   {
     kn_sleep_counter[t_id] = millis;
     kn_sleeping_threads |= mask;
@@ -324,13 +894,310 @@ void kn_sleep_long(uint32_t millis)
   }
 }
 
+void kn_wake(const thread_id t_id)
+{
+  kn_assert(t_id < MAX_THREADS);
+  uint8_t mask = bit_to_mask(t_id);
+  
+  KN_ATOMIC_BLOCK
+  {
+    if (kn_sleeping_threads & mask)
+    {
+      // same as the sleep expiring in the timer interrupt
+      kn_sleep_counter[t_id] = 0;
+      kn_unblock(mask);
+    }
+  }
+}
+
+bool kn_wait(wait_list* list, const uint16_t timeout)
+{
+  kn_assert(list != NULL);
+  return kn_block(list, timeout, NO_THREAD);
+}
+
+int8_t kn_wait_any(wait_list* const lists[], const uint8_t count, 
+                   const uint16_t timeout)
+{
+  kn_assert(lists != NULL);
+  kn_assert(count > 0 && count <= INT8_MAX);
+  #ifdef KERNEL_USE_IDLE_HOOK
+  kn_assert(!kn_idle_active);
+  #endif
+  #ifdef KERNEL_USE_NESTED_ISR
+  kn_assert(kn_isr_nesting == 0);
+  #endif
+  
+  thread_id t_id = kn_cur_thread;
+  uint8_t mask = kn_cur_thread_mask;
+  
+  // the thread is blocked once, with its bit in every list
+  uint8_t sreg = kn_critical_begin();
+  for (uint8_t i = 0; i < count; i++)
+  {
+    *lists[i] |= mask;
+  }
+  kn_blocked_threads |= mask;
+  kn_signaled_threads &= ~mask;
+  if (timeout != KN_WAIT_FOREVER)
+  {
+    kn_sleep_counter[t_id] = timeout;
+    kn_sleeping_threads |= mask;
+  }
+  
+  kn_yield();
+  
+  // a signal only clears the bit of the thread it wakes, and only while the 
+  // thread is blocked, so after a signal exactly one list lacks the bit
+  kn_critical_begin();
+  bool woken = (kn_signaled_threads & mask) != 0;
+  int8_t signaled = -1;
+  for (uint8_t i = 0; i < count; i++)
+  {
+    if (woken && (signaled < 0) && !(*lists[i] & mask))
+    {
+      signaled = i;
+    }
+    *lists[i] &= ~mask;
+  }
+  kn_critical_end(&sreg);
+  
+  return signaled;
+}
+
+bool kn_signal(wait_list* list)
+{
+  kn_assert(list != NULL);
+  bool signaled = false;
+  
+  KN_ATOMIC_BLOCK
+  {
+    // threads that timed out are left in the list, and remove themselves 
+    // when they run, but disabled threads are dropped
+    uint8_t waiting = *list & kn_blocked_threads & ~kn_disabled_threads;
+    // the lowest numbered waiting thread is woken
+    uint8_t mask = waiting & -waiting;
+    *list &= ~(mask | kn_disabled_threads);
+    if (mask)
+    {
+      kn_unblock_signaled(mask);
+      signaled = true;
+    }
+  }
+  
+  return signaled;
+}
+
+void kn_signal_all(wait_list* list)
+{
+  kn_assert(list != NULL);
+  
+  KN_ATOMIC_BLOCK
+  {
+    uint8_t waiting = *list & kn_blocked_threads & ~kn_disabled_threads;
+    *list &= ~(waiting | kn_disabled_threads);
+    kn_unblock_signaled(waiting);
+  }
+}
+
+void kn_notify(const thread_id t_id, const notify_action action,
+               const uint16_t value)
+{
+  kn_assert(t_id < MAX_THREADS);
+  uint8_t mask = bit_to_mask(t_id);
+  
+  KN_ATOMIC_BLOCK
+  {
+    switch (action)
+    {
+      case NOTIFY_SET_BITS:
+        kn_notify_value[t_id] |= value;
+        break;
+      case NOTIFY_INCREMENT:
+        if (kn_notify_value[t_id] != UINT16_MAX)
+        {
+          kn_notify_value[t_id]++;
+        }
+        break;
+      case NOTIFY_OVERWRITE:
+        kn_notify_value[t_id] = value;
+        break;
+    }
+    
+    // wake the thread directly, as kn_signal would
+    if ((kn_notify_waiters & mask) && kn_notify_value[t_id])
+    {
+      kn_notify_waiters &= ~mask;
+      kn_unblock_signaled(mask);
+    }
+  }
+}
+
+bool kn_notify_wait(uint16_t* value, const uint16_t timeout)
+{
+  kn_assert(value != NULL);
+  thread_id t_id = kn_cur_thread;
+  
+  KN_ATOMIC_BLOCK
+  {
+    while (kn_notify_value[t_id] == 0)
+    {
+      if (!kn_wait(&kn_notify_waiters, timeout))
+      {
+        return false;
+      }
+    }
+    
+    *value = kn_notify_value[t_id];
+    kn_notify_value[t_id] = 0;
+  }
+  
+  return true;
+}
+
+#ifdef KERNEL_USE_MESSAGES
+bool kn_send(const thread_id receiver, void* msg, void** reply,
+             const uint16_t timeout)
+{
+  kn_assert(receiver < MAX_THREADS);
+  kn_assert(receiver != kn_cur_thread);
+  
+  thread_id t_id = kn_cur_thread;
+  uint8_t mask = kn_cur_thread_mask;
+  uint8_t receiver_mask = bit_to_mask(receiver);
+  bool replied;
+  
+  KN_ATOMIC_BLOCK
+  {
+    kn_msg[t_id] = msg;
+    kn_msg_pending[receiver] |= mask;
+    
+    // hand the processor straight to the receiver if it is waiting
+    uint8_t next = NO_THREAD;
+    if (kn_receive_waiters & receiver_mask & kn_blocked_threads)
+    {
+      kn_receive_waiters &= ~receiver_mask;
+      kn_unblock_signaled(receiver_mask);
+      if (kn_thread_ready(receiver_mask))
+      {
+        next = receiver;
+      }
+    }
+    
+    replied = kn_block(&kn_reply_waiters, timeout, next);
+    
+    if (replied)
+    {
+      if (reply)
+      {
+        *reply = kn_msg[t_id];
+      }
+    }
+    else
+    {
+      kn_msg_pending[receiver] &= ~mask;
+    }
+  }
+  
+  return replied;
+}
+
+bool kn_receive(thread_id* sender, void** msg, const uint16_t timeout)
+{
+  kn_assert(sender != NULL);
+  kn_assert(msg != NULL);
+  
+  thread_id t_id = kn_cur_thread;
+  
+  KN_ATOMIC_BLOCK
+  {
+    uint8_t pending;
+    
+    // senders that stopped waiting (disabled or replaced) are dropped
+    while (!(pending = kn_msg_pending[t_id] & kn_reply_waiters & 
+      kn_blocked_threads))
+    {
+      kn_msg_pending[t_id] = 0;
+      if (!kn_wait(&kn_receive_waiters, timeout))
+      {
+        return false;
+      }
+    }
+    
+    // the lowest numbered sender goes first
+    uint8_t mask = pending & -pending;
+    kn_msg_pending[t_id] = pending & ~mask;
+    
+    thread_id id = THREAD0;
+    while (!(mask & 0x01))
+    {
+      mask >>= 1;
+      id++;
+    }
+    
+    *sender = id;
+    *msg = kn_msg[id];
+  }
+  
+  return true;
+}
+
+void kn_reply(const thread_id sender, void* reply)
+{
+  kn_assert(sender < MAX_THREADS);
+  kn_assert(sender != kn_cur_thread);
+  
+  uint8_t mask = bit_to_mask(sender);
+  
+  KN_ATOMIC_BLOCK
+  {
+    if (kn_reply_waiters & mask & kn_blocked_threads)
+    {
+      kn_msg[sender] = reply;
+      kn_reply_waiters &= ~mask;
+      kn_unblock_signaled(mask);
+      
+      if (kn_thread_ready(mask))
+      {
+        kn_switch_to(sender);
+      }
+    }
+  }
+}
+#endif
+
+#ifdef KERNEL_USE_HOG_DETECT
+uint16_t kn_thread_max_run(const thread_id t_id)
+{
+  kn_assert(t_id < MAX_THREADS);
+  
+  uint16_t ticks;
+  
+  KN_ATOMIC_BLOCK
+  {
+    ticks = kn_run_max[t_id];
+    // the current run is only recorded when it ends
+    if (kn_run_active && (t_id == kn_cur_thread) && (kn_run_ticks > ticks))
+    {
+      ticks = kn_run_ticks;
+    }
+  }
+  
+  return ticks;
+}
+#endif
+
 uint32_t kn_millis()
 {
   uint32_t millis;
-  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  uint8_t seq;
+  
+  // the timer interrupt is the only writer, so retry instead of disabling it
+  do
   {
+    seq = kn_seqlock_read_begin(&kn_system_seq);
     millis = kn_system_counter;
-  }
+  } while (kn_seqlock_read_retry(&kn_system_seq, seq));
   return millis;
 }
 
@@ -345,7 +1212,8 @@ bool kn_thread_suspended(const thread_id t_id)
   kn_assert(t_id < MAX_THREADS);
   uint8_t mask = bit_to_mask(t_id);
   return ((kn_disabled_threads & mask) == 0) &&
-         ((kn_suspended_threads & mask) != 0);
+         (((kn_suspended_threads | 
+            (kn_blocked_threads & kn_resume_waiters)) & mask) != 0);
 }
 
 bool kn_thread_sleeping(const thread_id t_id)
@@ -353,9 +1221,18 @@ bool kn_thread_sleeping(const thread_id t_id)
   kn_assert(t_id < MAX_THREADS); 
   uint8_t mask = bit_to_mask(t_id);
   return ((kn_disabled_threads & mask) == 0) &&
+         ((kn_blocked_threads & mask) == 0) &&
          ((kn_sleeping_threads & mask) != 0);
 }
 
+bool kn_thread_blocked(const thread_id t_id)
+{
+  kn_assert(t_id < MAX_THREADS); 
+  uint8_t mask = bit_to_mask(t_id);
+  return ((kn_disabled_threads & mask) == 0) &&
+         ((kn_blocked_threads & mask & ~kn_resume_waiters) != 0);
+}
+
 void kn_disable(const thread_id t_id)
 {
   kn_assert(t_id < MAX_THREADS);
@@ -369,7 +1246,22 @@ void kn_disable(const thread_id t_id)
 void kn_resume(const thread_id t_id)
 {
   kn_assert(t_id < MAX_THREADS);
-  kn_suspended_threads &= ~bit_to_mask(t_id);
+  uint8_t mask = bit_to_mask(t_id);
+  
+  KN_ATOMIC_BLOCK
+  {
+    kn_suspended_threads &= ~mask;
+    if (kn_resume_waiters & mask & kn_blocked_threads)
+    {
+      kn_resume_waiters &= ~mask;
+      kn_unblock_signaled(mask);
+    }
+  }
+}
+
+bool kn_suspend_timeout(const uint16_t timeout)
+{
+  return kn_wait(&kn_resume_waiters, timeout);
 }
 
 void kn_suspend(const thread_id t_id)
@@ -381,38 +1273,3 @@ void kn_suspend(const thread_id t_id)
     kn_yield();
   }
 }
-
-/******************************************************************************
- * Interrupts
- *****************************************************************************/
-
-/** \cond */
-ISR(TIMER0_COMPA_vect)
-{
-  kn_system_counter++;  
-  
-  // grab a local copy of the sleep state to avoid a read every time it is used
-  uint8_t sleeping = kn_sleeping_threads;  
-  thread_id t_id = THREAD0;
-  uint8_t mask = 0x01;
-  
-  // sleeping will be 0 when no threads are asleep
-  // mask will become 0 if all threads have been checked
-  while (sleeping && (t_id < MAX_THREADS))
-  {
-    // see if this thread is sleeping
-    if (sleeping & mask)
-    {
-      if (--kn_sleep_counter[t_id] == 0)
-      {
-        sleeping &= ~mask;
-      }
-    }
-    
-    t_id++;
-    mask <<= 1;
-  }
-  
-  kn_sleeping_threads = sleeping;
-}
-/** \endcond */
@@ -29,15 +29,200 @@
 #define TMP_REG r0
 #define ZERO_REG r1
 
+// the bottom of each pooled stack is the bottom of its guard zone
+#ifdef KERNEL_USE_STACK_POOL
+  #define CANARY_TABLE kn_stack_end
+#else
+  #define CANARY_TABLE kn_canary_loc
+#endif
+
+// Points Z at the byte \offset of a table in program memory.  On MCUs with 
+// more than 64 KB of flash RAMPZ is also loaded so that the table may be 
+// read with elpm.  \tmp is clobbered.
+.macro LOAD_PM_TABLE table, offset, tmp
+  ldi ZL, lo8(\table)
+  ldi ZH, hi8(\table)
+  add ZL, \offset
+  adc ZH, ZERO_REG
+#ifdef __AVR_HAVE_ELPM__
+  ldi \tmp, hh8(\table)
+  adc \tmp, ZERO_REG
+  out RAMPZ, \tmp
+#endif
+.endm
+
+// Reads a byte from program memory at Z into \reg, and post increments Z.
+.macro READ_PM reg
+#ifdef __AVR_HAVE_ELPM__
+  elpm \reg, Z+
+#else
+  lpm \reg, Z+
+#endif
+.endm
+
+// Points Z at the byte \offset of one of the stack tables, which are in RAM 
+// if KERNEL_USE_STACK_POOL is defined and in program memory otherwise.  
+// \tmp is clobbered.
+.macro LOAD_STACK_TABLE table, offset, tmp
+#ifdef KERNEL_USE_STACK_POOL
+  ldi ZL, lo8(\table)
+  ldi ZH, hi8(\table)
+  add ZL, \offset
+  adc ZH, ZERO_REG
+#else
+  LOAD_PM_TABLE \table, \offset, \tmp
+#endif
+.endm
+
+// Reads a byte from a stack table at Z into \reg, and post increments Z.
+.macro READ_STACK_TABLE reg
+#ifdef KERNEL_USE_STACK_POOL
+  ld \reg, Z+
+#else
+  READ_PM \reg
+#endif
+.endm
+
+// Disables interrupts.  If they were enabled, also starts timing a critical 
+// section for the kernel's statistics.  \tmp is clobbered.
+.macro CRITICAL_BEGIN tmp
+#ifdef KERNEL_USE_CRITICAL_STATS
+  in \tmp, SREG
+  cli
+  sbrs \tmp, SREG_I
+  rjmp 1f
+#ifdef CRITICAL_STATS_TIMER1
+  // the low byte must be read first to latch the high byte
+  lds \tmp, TCNT1L
+  sts kn_critical_start, \tmp
+  lds \tmp, TCNT1H
+  sts kn_critical_start + 1, \tmp
+#else
+  in \tmp, TCNT0
+  sts kn_critical_start, \tmp
+#endif
+  ldi \tmp, 1
+  sts kn_critical_open, \tmp
+1:
+#else
+  cli
+#endif
+.endm
+
+// Ends timing a critical section, just before interrupts are enabled again.  
+// Nothing is recorded if the section was entered with interrupts already 
+// disabled, since no start time was taken.  Clobbers all of the call-used 
+// registers if statistics are enabled.
+.macro CRITICAL_END
+#ifdef KERNEL_USE_CRITICAL_STATS
+  call kn_critical_record
+#endif
+.endm
+
+// Pushes the callee saved registers of the calling thread, which are all 
+// that a thread has to keep when it calls into the kernel.
+.macro PUSH_THREAD_STATE
+  push r2
+  push r3
+  push r4
+  push r5
+  push r6
+  push r7
+  push r8
+  push r9
+  push r10
+  push r11
+  push r12
+  push r13
+  push r14
+  push r15
+  push r16
+  push r17
+  push r28
+  push r29  
+.endm
+
+// Checks the guard zone of the current thread and saves its stack pointer, 
+// after PUSH_THREAD_STATE.  Leaves interrupts disabled for the scheduler.  
+// Clobbers r23-r25, X and Z.
+.macro SAVE_THREAD_STACK
+  // get the current thread id and make it a pointer offset
+  lds r24, kn_cur_thread
+  lsl r24
+  // check the guard zone
+#ifdef KERNEL_USE_STACK_CANARY
+  // guard zone pointer for this thread in Z
+  LOAD_STACK_TABLE CANARY_TABLE, r24, r25
+  // and load the guard zone pointer in X
+  READ_STACK_TABLE XL
+  READ_STACK_TABLE XH
+  // load and compare each canary value
+  ldi r23, STACK_GUARD_SIZE
+5:
+  ld r25, X+
+  cpi r25, STACK_CANARY
+  brne 6f
+  dec r23
+  brne 5b
+  rjmp 7f
+6:
+  // restore the thread id for the function parameter
+  lsr r24
+  call kn_stack_overflow
+  // the call may have clobbered the pointer offset
+  lds r24, kn_cur_thread
+  lsl r24
+#endif
+7:
+  // stack array pointer in X
+  ldi XL, lo8(kn_stack)
+  ldi XH, hi8(kn_stack)
+  // add the offset for this thread
+  add XL, r24
+  adc XH, ZERO_REG
+  // get the hardware stack pointer and save it using X
+  CRITICAL_BEGIN r25
+  in r24, SPL
+  in r25, SPH
+  st X+, r24
+  st X, r25
+  // interrupts stay off for the scheduler
+.endm
+
 // external symbols from kernel.c
-.extern kn_stack_base // program memory
-.extern kn_canary_loc // program memory
+.extern kn_bitmasks // program memory
+// the stack tables are in program memory unless the stack pool is used
+.extern kn_stack_base
+#ifdef KERNEL_USE_STACK_POOL
+.extern kn_stack_end
+#else
+.extern kn_canary_loc
+#endif
 .extern kn_cur_thread
 .extern kn_cur_thread_mask
 .extern kn_disabled_threads
 .extern kn_suspended_threads
 .extern kn_sleeping_threads
+.extern kn_blocked_threads
 .extern kn_stack
+.extern kn_idle_hook
+.extern kn_idle_stack
+.extern kn_idle_active
+.extern kn_critical_start
+.extern kn_critical_open
+.extern kn_critical_record
+.extern kn_edf_select
+.extern kn_stack_limit
+.extern kn_system_counter
+.extern kn_system_seq
+.extern kn_tick
+.extern kn_cyclic_active
+.extern kn_run_active
+.extern kn_run_ticks
+.extern kn_run_record
+.extern kn_cyclic_tick
+.extern kn_cyclic_deferred
+.extern kn_cyclic_run_deferred
 
 // external user defined symbols
 .extern kn_assertion_failure
@@ -68,103 +253,94 @@ kn_create_thread:
   cp r26, r24
   brne .call_impl
   // if yes, load the stack base
-  ldi ZL, lo8(kn_stack_base)
-  ldi ZH, hi8(kn_stack_base)
-  add r31, r24
-  adc r30, r1
-  lpm r26, Z+
-  lpm r27, Z
-  // add space for the new thread usage
-  adiw r26, INITIAL_STACK_USAGE
+  lsl r26
+  LOAD_STACK_TABLE kn_stack_base, r26, r27
+  READ_STACK_TABLE r26
+  READ_STACK_TABLE r27
+  // move below the space that the new thread's frame will use
+  sbiw r26, INITIAL_STACK_USAGE
   // set the stack pointer (atomic block restore state)
   in TMP_REG, SREG
   cli
-  out SPH, r26
-  out SPL, r27
+  out SPH, r27
+  out SPL, r26
   out SREG, TMP_REG
   // end atomic block
 .call_impl:
   call kn_create_thread_impl
   ret
 
+// void kn_yield_if_needed()
+// see documentation in kernel.h
+// falls through to kn_yield if another thread is ready
+.global kn_yield_if_needed
+kn_yield_if_needed:
+  // no critical section, a thread that becomes ready during the test is run 
+  // at the next call
+  lds r24, kn_disabled_threads
+  lds r25, kn_suspended_threads
+  or r24, r25
+  lds r25, kn_sleeping_threads
+  or r24, r25
+  lds r25, kn_blocked_threads
+  or r24, r25
+  // the calling thread is always ready, so leave it out
+  lds r25, kn_cur_thread_mask
+  or r24, r25
+  com r24
+  andi r24, (1 << MAX_THREADS) - 1
+  brne kn_yield
+  ret
+
 // void kn_yield()
 // see documentation in kernel.h
 // note that kn_yield falls through to the scheduler and does not return itself
 .global kn_yield
 kn_yield:
-  // save the thread state
-  push r2
-  push r3
-  push r4
-  push r5
-  push r6
-  push r7
-  push r8
-  push r9
-  push r10
-  push r11
-  push r12
-  push r13
-  push r14
-  push r15
-  push r16
-  push r17
-  push r28
-  push r29  
-  // get the current thread id and make it a pointer offset
-  lds r24, kn_cur_thread
-  lsl r24
-  // check the stack canary
-#ifdef KERNEL_USE_STACK_CANARY
-  // base canary pointer in Z
-  ldi ZL, lo8(kn_canary_loc)
-  ldi ZH, hi8(kn_canary_loc)
-  // add the offset for this thread
-  add ZL, r24
-  adc ZH, ZERO_REG
-  // and load the canary pointer in X
-  lpm XL, Z+
-  lpm XH, Z
-  // load and compare the canary value
-  ld r25, X
-  cpi r25, STACK_CANARY
-  breq .save_stack
-  // restore the thread id for the function parameter
-  lsr r24
-  call kn_stack_overflow
-#endif
-.save_stack:
-  // stack array pointer in X
-  ldi XL, lo8(kn_stack)
-  ldi XH, hi8(kn_stack)
-  // add the offset for this thread
-  add XL, r24
-  adc XH, ZERO_REG
-  // get the hardware stack pointer and save it using X
-  cli
-  in r24, SPL
-  in r25, SPH
-  st X+, r24
-  st X, r25
-  // interrupts stay off for the scheduler
+  PUSH_THREAD_STATE
+  SAVE_THREAD_STACK
 
 // void kn_scheduler()
 // see documentation in kernel.c
 .global kn_scheduler
 kn_scheduler:
+#ifdef KERNEL_USE_HOG_DETECT
+  // time spent in the scheduler does not count against any thread
+  sts kn_run_active, ZERO_REG
+  // nothing is live yet, so the call may clobber the call used registers
+  call kn_run_record
+#endif
   // thread id in r24, mask in r25
   lds r24, kn_cur_thread
   lds r25, kn_cur_thread_mask
   // keep a copy of the id
   mov r23, r24
 .scheduler_start:
-  cli
+  CRITICAL_BEGIN r27
   // refresh the status masks, or them into a single mask
   lds r26, kn_disabled_threads
   lds r27, kn_suspended_threads
   lds r28, kn_sleeping_threads
   or r26, r27
   or r26, r28
+  lds r27, kn_blocked_threads
+  or r26, r27
+#ifdef KERNEL_USE_EDF
+  // a ready periodic thread always goes first, by earliest deadline
+  // the state of every thread has been saved, so r16 is free to keep the 
+  // mask across the call
+  mov r16, r26
+  mov r24, r26
+  call kn_edf_select
+  // id in r24 and mask in r25, as .restore_thread expects
+  tst r25
+  brne .restore_thread
+  // otherwise round robin among the other threads
+  mov r26, r16
+  lds r24, kn_cur_thread
+  lds r25, kn_cur_thread_mask
+  mov r23, r24
+#endif
 .scheduler_loop:
   // shift to the next thread
   inc r24
@@ -184,24 +360,105 @@ kn_scheduler:
   cp r24, r23
   brne .scheduler_loop
   // if so, no threads are ready
+#if defined(KERNEL_USE_IDLE_HOOK) && defined(KERNEL_USE_CYCLIC)
+  // a slot that started while SP was on the idle stack runs first, on the 
+  // stack of the current thread
+  lds r26, kn_cyclic_deferred
+  tst r26
+  breq .idle_hook
+  // kn_stack only holds a valid stack pointer if the thread yielded; a thread 
+  // that was disabled or exited did not save it, and under 
+  // KERNEL_USE_STACK_POOL its stack is back in the pool, so the slot waits 
+  // until a thread that yielded finds nothing ready
+  lds r26, kn_disabled_threads
+  lds r27, kn_cur_thread_mask
+  and r26, r27
+  brne .idle_hook
+  ldi XL, lo8(kn_stack)
+  ldi XH, hi8(kn_stack)
+  lds r24, kn_cur_thread
+  lsl r24
+  add XL, r24
+  adc XH, ZERO_REG
+  ld r24, X+
+  ld r25, X
+  out SPL, r24
+  out SPH, r25
+  sts kn_idle_active, ZERO_REG
+  CRITICAL_END
+  // enables interrupts while the task runs, and returns with them disabled
+  call kn_cyclic_run_deferred
+  // the task may have made a thread ready
+  rjmp kn_scheduler
+.idle_hook:
+#endif
+#ifdef KERNEL_USE_IDLE_HOOK
+  // see if an idle hook is registered
+  // the state of every thread has been saved, so the callee saved registers 
+  // are free to use
+  lds r16, kn_idle_hook
+  lds r17, kn_idle_hook + 1
+  cp r16, ZERO_REG
+  cpc r17, ZERO_REG
+  breq .idle_sleep
+  // the hook runs on the kernel's idle stack
+  ldi r26, lo8(kn_idle_stack + IDLE_STACK_SIZE - 1)
+  ldi r27, hi8(kn_idle_stack + IDLE_STACK_SIZE - 1)
+  out SPL, r26
+  out SPH, r27
+  ldi r26, 1
+  sts kn_idle_active, r26
+  CRITICAL_END
+  movw ZL, r16
+  sei
+#ifdef __AVR_HAVE_EIJMP_EICALL__
+  eicall
+#else
+  icall
+#endif
+  CRITICAL_BEGIN r25
+  // kn_idle_active stays set while SP is on the idle stack, including the 
+  // sleep below, and is cleared when a thread's stack is restored
+  // the hook returns false when it had nothing to do
+  tst r24
+  breq .idle_sleep
+  // otherwise check for ready threads again before calling it another time
+  // the call clobbered the scheduler's registers, so start over
+  rjmp kn_scheduler
+.idle_sleep:
+#endif
   // enable sleep
   in r26, SMCR
-  sbr r26, SE
+  sbr r26, (1 << SE)
   out SMCR, r26
   // sleep and wait for an interrupt
+  CRITICAL_END
   sei
   sleep
   // disable sleep
   in r26, SMCR
-  cbr r26, SE
+  cbr r26, (1 << SE)
   out SMCR, r26
   // restart the scheduler
-  rjmp .scheduler_start
+  // the current thread is the starting point again, so reload the 
+  // scheduler's registers in case they were clobbered
+  rjmp kn_scheduler
 .restore_thread:
-  sei
+  // interrupts stay off until the stack pointer has been switched, so that 
+  // an interrupt never sees kn_cur_thread and SP that disagree
   // save the thread id and mask
   sts kn_cur_thread, r24
   sts kn_cur_thread_mask, r25
+#ifdef KERNEL_USE_IDLE_HOOK
+  // SP is about to leave the idle stack, if it was on it
+  sts kn_idle_active, ZERO_REG
+#endif
+#ifdef KERNEL_USE_HOG_DETECT
+  // start timing the thread's run, the mask is never 0
+  sts kn_run_ticks, ZERO_REG
+  sts kn_run_ticks + 1, ZERO_REG
+  sts kn_run_active, r25
+#endif
   // stack array pointer in X
   ldi XL, lo8(kn_stack)
   ldi XH, hi8(kn_stack)
@@ -213,9 +470,9 @@ kn_scheduler:
   ld r24, X+
   ld r25, X
   // write it to hardware
-  cli
   out SPL, r24
   out SPH, r25
+  CRITICAL_END
   sei
   // restore the thread state
   pop r29
@@ -238,11 +495,219 @@ kn_scheduler:
   pop r2
   ret
 
+// void kn_switch_to(const thread_id t_id)
+// see documentation in kernel.c
+.global kn_switch_to
+kn_switch_to:
+  PUSH_THREAD_STATE
+  // the target survives the guard check in a register that has been saved
+  mov r16, r24
+  SAVE_THREAD_STACK
+  // id in r24 and mask in r25, as .restore_thread expects
+  mov r24, r16
+  LOAD_PM_TABLE kn_bitmasks, r24, r25
+  READ_PM r25
+  rjmp .restore_thread
+
 // void kn_thread_bootstrap()
 // see documentation in kernel.c
+// the return pops the thread's entry point, which is 3 bytes on MCUs with a 
+// 22 bit program counter
 .global kn_thread_bootstrap
 kn_thread_bootstrap:
   pop r24
   pop r23
   pop r22    
-  ret
\ No newline at end of file
+  ret
+
+/******************************************************************************
+ * Interrupts
+ *****************************************************************************/
+
+// the kernel tick, once per millisecond
+// on most ticks no thread is sleeping, so the interrupt only bumps the system 
+// counter and checks the stack, saving just the registers it uses; when a 
+// thread is sleeping (or the stack check fails) the remaining call used 
+// registers are saved and the work is done in C by kn_tick
+// cycles from the vector jump to reti, on a 2 byte PC MCU with the default 
+// config (stack check and canaries on): 76 with no sleepers, against about 
+// 127 for the C version, which saved 14 registers on every tick
+// both figures are hand counts from the instruction timings, not 
+// measurements; the test/tick_cycles program can measure the interrupt, but 
+// has not been run yet
+.global TIMER0_COMPA_vect
+TIMER0_COMPA_vect:
+  push r24
+  in r24, SREG
+  push r24
+  // the sequence is odd while the counter is updated, so that kn_millis 
+  // can detect a torn read
+  lds r24, kn_system_seq
+  inc r24
+  sts kn_system_seq, r24
+  // 32 bit increment of the system counter, stopping at the first byte that 
+  // does not wrap
+  // subtracting 0xFF adds 1, and leaves carry set unless the byte wrapped
+  lds r24, kn_system_counter
+  subi r24, 0xFF
+  sts kn_system_counter, r24
+  brcs .tick_counted
+  lds r24, kn_system_counter + 1
+  subi r24, 0xFF
+  sts kn_system_counter + 1, r24
+  brcs .tick_counted
+  lds r24, kn_system_counter + 2
+  subi r24, 0xFF
+  sts kn_system_counter + 2, r24
+  brcs .tick_counted
+  lds r24, kn_system_counter + 3
+  subi r24, 0xFF
+  sts kn_system_counter + 3, r24
+.tick_counted:
+  lds r24, kn_system_seq
+  inc r24
+  sts kn_system_seq, r24
+#ifdef KERNEL_USE_STACK_CHECK
+  // a failed check is flagged in T, which is restored along with SREG
+  clt
+#ifdef KERNEL_USE_IDLE_HOOK
+  // the idle hook runs on the kernel's own stack, which is not checked
+  lds r24, kn_idle_active
+  tst r24
+  brne .tick_checked
+#endif
+  push r25
+  push ZL
+  push ZH
+#ifdef __AVR_HAVE_ELPM__
+  in r24, RAMPZ
+  push r24
+#endif
+  // the stack limit of the current thread in r25:r24
+  // the scheduler only enables interrupts once the stack pointer matches 
+  // kn_cur_thread, so the bounds are always those of the interrupted thread
+  lds r24, kn_cur_thread
+  lsl r24
+  LOAD_STACK_TABLE kn_stack_limit, r24, r25
+  READ_STACK_TABLE r24
+  READ_STACK_TABLE r25
+  // the live stack pointer includes this interrupt's own frame
+  in ZL, SPL
+  in ZH, SPH
+  cp ZL, r24
+  cpc ZH, r25
+  brlo .tick_overflow
+#ifdef KERNEL_USE_STACK_CANARY
+  // the topmost byte of the guard zone
+  movw ZL, r24
+  ld r24, Z
+  cpi r24, STACK_CANARY
+  breq .tick_stack_ok
+#else
+  rjmp .tick_stack_ok
+#endif
+.tick_overflow:
+  set
+.tick_stack_ok:
+#ifdef __AVR_HAVE_ELPM__
+  pop r24
+  out RAMPZ, r24
+#endif
+  pop ZH
+  pop ZL
+  pop r25
+.tick_checked:
+  brts .tick_slow
+#endif
+#ifdef KERNEL_USE_HOG_DETECT
+  // a running thread is timed on every tick, and the count stops at 0xFFFF
+  // the slow path is only taken to report the thread when the count goes 
+  // over HOG_BUDGET
+  lds r24, kn_run_active
+  tst r24
+  breq .tick_run_counted
+  lds r24, kn_run_ticks
+  subi r24, 0xFF
+  brcs .tick_run_low
+  lds r24, kn_run_ticks + 1
+  cpi r24, 0xFF
+  breq .tick_run_counted
+  inc r24
+  sts kn_run_ticks + 1, r24
+  // r1 may not be zero in the interrupted code
+  clr r24
+.tick_run_low:
+  sts kn_run_ticks, r24
+#ifdef HOG_BUDGET
+  cpi r24, lo8(HOG_BUDGET + 1)
+  brne .tick_run_counted
+  lds r24, kn_run_ticks + 1
+  cpi r24, hi8(HOG_BUDGET + 1)
+  breq .tick_slow
+#endif
+.tick_run_counted:
+#endif
+#ifdef KERNEL_USE_CYCLIC
+  // the cyclic executive counts every tick
+  lds r24, kn_cyclic_active
+  tst r24
+  brne .tick_slow
+#endif
+  lds r24, kn_sleeping_threads
+  tst r24
+  brne .tick_slow
+  pop r24
+  out SREG, r24
+  pop r24
+  reti
+.tick_slow:
+  // save the rest of the call used registers for the calls into C
+  push r0
+  push r1
+  push r18
+  push r19
+  push r20
+  push r21
+  push r22
+  push r23
+  push r25
+  push r26
+  push r27
+  push r30
+  push r31
+#ifdef __AVR_HAVE_ELPM__
+  in r24, RAMPZ
+  push r24
+#endif
+  clr ZERO_REG
+#ifdef KERNEL_USE_STACK_CHECK
+  brtc .tick_sleepers
+  lds r24, kn_cur_thread
+  call kn_stack_overflow
+.tick_sleepers:
+#endif
+  call kn_tick
+#ifdef KERNEL_USE_CYCLIC
+  call kn_cyclic_tick
+#endif
+#ifdef __AVR_HAVE_ELPM__
+  pop r24
+  out RAMPZ, r24
+#endif
+  pop r31
+  pop r30
+  pop r27
+  pop r26
+  pop r25
+  pop r23
+  pop r22
+  pop r21
+  pop r20
+  pop r19
+  pop r18
+  pop r1
+  pop r0
+  pop r24
+  out SREG, r24
+  pop r24
+  reti
@@ -0,0 +1,128 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Implements worker thread pools.
+ * \see kernel_pool
+ */
+
+#include "kernel.h"
+#include "kernel_pool.h"
+#include "kernel_debug.h"
+#include "kernel_atomic.h"
+
+/**
+ * The thread function run by each worker.  Takes jobs from the front of the 
+ * queue, and blocks on the pool's wait list when the queue is empty.
+ * 
+ * \param[in] my_id The thread id of the worker.
+ * \param[in] arg The \ref thread_pool that the worker serves.
+ * 
+ * \ingroup kernel_implementation
+ */
+static void kn_pool_worker(const thread_id my_id, void* arg)
+  __attribute__((OS_task));
+
+void kn_pool_worker(const thread_id my_id, void* arg)
+{
+  (void)my_id;
+  thread_pool* pool = (thread_pool*)arg;
+  
+  while (1)
+  {
+    pool_job job;
+    
+    KN_ATOMIC_BLOCK
+    {
+      while (pool->count == 0)
+      {
+        kn_wait(&pool->idle_workers, KN_WAIT_FOREVER);
+      }
+      
+      job = pool->jobs[pool->head];
+      if (++pool->head == pool->size)
+      {
+        pool->head = 0;
+      }
+      pool->count--;
+    }
+    
+    job.func(job.arg);
+  }
+}
+
+void kn_pool_init(thread_pool* pool, pool_job* jobs, const uint8_t size)
+{
+  kn_assert(pool != NULL);
+  kn_assert(jobs != NULL);
+  kn_assert(size > 0);
+  
+  pool->jobs = jobs;
+  pool->size = size;
+  pool->head = 0;
+  pool->count = 0;
+  pool->idle_workers = 0;
+}
+
+void kn_pool_add_worker(thread_pool* pool, const thread_id t_id)
+{
+  kn_assert(pool != NULL);
+  kn_assert(t_id < MAX_THREADS);
+  
+  kn_create_thread(t_id, &kn_pool_worker, false, pool);
+}
+
+#ifdef KERNEL_USE_STACK_POOL
+bool kn_pool_add_pooled_worker(thread_pool* pool, const thread_id t_id, 
+                               const uint16_t stack_size)
+{
+  kn_assert(pool != NULL);
+  
+  return kn_create_pooled_thread(t_id, &kn_pool_worker, false, pool, 
+                                 stack_size);
+}
+#endif
+
+bool kn_pool_post(thread_pool* pool, job_ptr func, void* arg)
+{
+  kn_assert(pool != NULL);
+  kn_assert(func != NULL);
+  
+  bool queued = false;
+  
+  KN_ATOMIC_BLOCK
+  {
+    if (pool->count < pool->size)
+    {
+      uint8_t tail = pool->head + pool->count;
+      if (tail >= pool->size)
+      {
+        tail -= pool->size;
+      }
+      pool->jobs[tail].func = func;
+      pool->jobs[tail].arg = arg;
+      pool->count++;
+      queued = true;
+      
+      kn_signal(&pool->idle_workers);
+    }
+  }
+  
+  return queued;
+}
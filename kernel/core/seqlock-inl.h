@@ -0,0 +1,61 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Inline function definitions for sequence counters.
+ * 
+ * \see kernel_seqlock
+ */
+
+#ifndef SEQLOCK_INL_H_
+#define SEQLOCK_INL_H_
+
+/** \cond */
+// keeps the compiler from moving accesses to the protected data across the 
+// counter accesses
+#define SEQLOCK_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+/** \endcond */
+
+void kn_seqlock_write_begin(seqlock* const lock)
+{
+  (*lock)++;
+  SEQLOCK_BARRIER();
+}
+
+void kn_seqlock_write_end(seqlock* const lock)
+{
+  SEQLOCK_BARRIER();
+  (*lock)++;
+}
+
+uint8_t kn_seqlock_read_begin(const seqlock* const lock)
+{
+  uint8_t start = *lock;
+  SEQLOCK_BARRIER();
+  return start;
+}
+
+bool kn_seqlock_read_retry(const seqlock* const lock, const uint8_t start)
+{
+  SEQLOCK_BARRIER();
+  // an odd start means the read began in the middle of an update
+  return (start & 1) || *lock != start;
+}
+
+#endif /* SEQLOCK_INL_H_ */
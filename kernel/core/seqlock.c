@@ -0,0 +1,76 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Implements double buffers.
+ * \see kernel_seqlock
+ */
+
+#include "kernel_seqlock.h"
+
+void kn_double_buffer_write_impl(seqlock* const seq, 
+  volatile void* const copies, const void* const value, const uint8_t size)
+{
+  // the copy after the current one, which readers are not using
+  // a reader can only run in the middle of this by interrupting it, and then 
+  // it sees the old sequence and reads the other copy
+  volatile uint8_t* dest = (volatile uint8_t*)copies;
+  if ((*seq & 1) == 0)
+  {
+    dest += size;
+  }
+  
+  const uint8_t* src = (const uint8_t*)value;
+  for (uint8_t i = 0; i < size; i++)
+  {
+    dest[i] = src[i];
+  }
+  
+  SEQLOCK_BARRIER();
+  // publishing is a single byte store
+  (*seq)++;
+}
+
+void kn_double_buffer_read_impl(const seqlock* const seq, 
+  const volatile void* const copies, void* const value, const uint8_t size)
+{
+  uint8_t start;
+  uint8_t* dest = (uint8_t*)value;
+  
+  do
+  {
+    start = *seq;
+    SEQLOCK_BARRIER();
+    
+    const volatile uint8_t* src = (const volatile uint8_t*)copies;
+    if (start & 1)
+    {
+      src += size;
+    }
+    
+    for (uint8_t i = 0; i < size; i++)
+    {
+      dest[i] = src[i];
+    }
+    
+    SEQLOCK_BARRIER();
+    // the first write after start goes to the other copy, so the one that 
+    // was read is only overwritten by a second write
+  } while ((uint8_t)(*seq - start) >= 2);
+}
@@ -28,26 +28,80 @@
 #include "config.h"
 #include <avr/io.h>
 
-/**
- * The minimum size of each stack.
- * \see stack_size
+/** \def RETURN_ADDR_SIZE
+ * The number of bytes pushed to the stack for a return address.  MCUs with 
+ * more than 128 KB of flash (such as the ATmega2560) have a 22 bit program 
+ * counter, so \c call and \c ret use 3 bytes instead of 2.
  * \ingroup kernel_implementation
  */
-#define MIN_STACK_SIZE 32
+#ifdef __AVR_3_BYTE_PC__
+  #define RETURN_ADDR_SIZE 3
+#else
+  #define RETURN_ADDR_SIZE 2
+#endif
 
 /**
  * The amount of space used when a stack is set up for a new thread.
  * 
- * Space requirements are: entry point address (2 bytes), thread parameters 
- * (\ref thread_id and pointer; 3 bytes), bootstrap function address (2 bytes), 
- * 18 callee save registers (18 bytes).  The callee save registers are 
- * necessary because a thread is entered by returning from the scheduler in the 
- * same manner as yielding.
+ * Space requirements are: exit trampoline address (\ref RETURN_ADDR_SIZE 
+ * bytes), entry point address (\ref RETURN_ADDR_SIZE bytes), thread 
+ * parameters (\ref thread_id and pointer; 3 bytes), bootstrap function 
+ * address (\ref RETURN_ADDR_SIZE bytes), 18 callee save registers (18 bytes).  
+ * The callee save registers are necessary because a thread is entered by 
+ * returning from the scheduler in the same manner as yielding.  The exit 
+ * trampoline address is left on the stack when the thread function is 
+ * entered, so that returning from it disables the thread.
  * 
  * \see stack_size
  * \ingroup kernel_implementation
  */
-#define INITIAL_STACK_USAGE 25
+#define INITIAL_STACK_USAGE (3 * RETURN_ADDR_SIZE + 21)
+
+/** \def TICK_CHECK_FRAME
+ * The number of bytes that the tick interrupt has pushed when it compares the 
+ * stack pointer against the stack limit: the return address, r24, SREG, r25 
+ * and Z, and RAMPZ on MCUs that have it.
+ * \ingroup kernel_implementation
+ */
+#ifdef __AVR_HAVE_ELPM__
+  #define TICK_CHECK_FRAME (RETURN_ADDR_SIZE + 6)
+#else
+  #define TICK_CHECK_FRAME (RETURN_ADDR_SIZE + 5)
+#endif
+
+/** \def GUARD_ZONE_SIZE
+ * The number of bytes at the top of each stack that are reserved for canary 
+ * values.
+ * \ingroup kernel_implementation
+ */
+#ifdef KERNEL_USE_STACK_CANARY
+  #define GUARD_ZONE_SIZE STACK_GUARD_SIZE
+#else
+  #define GUARD_ZONE_SIZE 0
+#endif
+
+/**
+ * The minimum size of each stack.  A new thread's initial frame must fit 
+ * above the guard zone with room for the tick interrupt to check the stack 
+ * before the thread has popped any of it, or the check would fail as soon as 
+ * the thread first runs.  This is 34 bytes plus the guard zone on the 
+ * ATmega328P, and 39 bytes plus the guard zone on the ATmega2560.
+ * \see stack_size
+ * \ingroup kernel_implementation
+ */
+#define MIN_STACK_SIZE \
+  (INITIAL_STACK_USAGE + TICK_CHECK_FRAME + GUARD_ZONE_SIZE)
+
+/** \def STATIC_THREADS
+ * The number of threads whose stacks are laid out at compile time.  With 
+ * \ref KERNEL_USE_STACK_POOL only \c THREAD0 has a fixed stack.
+ * \ingroup kernel_implementation
+ */
+#ifdef KERNEL_USE_STACK_POOL
+  #define STATIC_THREADS 1
+#else
+  #define STATIC_THREADS MAX_THREADS
+#endif
 
 /**
  * The total size of the RAM available on the MCU.
@@ -71,6 +125,14 @@
   #error "KERNEL_USE_STACK_CANARY defined but STACK_CANARY undefined"
 #endif
 
+// verify the size of the guard zone
+#if defined(KERNEL_USE_STACK_CANARY) && !defined(STACK_GUARD_SIZE)
+  #error "KERNEL_USE_STACK_CANARY defined but STACK_GUARD_SIZE undefined"
+#elif defined(KERNEL_USE_STACK_CANARY) && \
+  ((STACK_GUARD_SIZE < 1) || (STACK_GUARD_SIZE > 8))
+  #error "STACK_GUARD_SIZE must be in the range [1,8]"
+#endif
+
 // thread size checking
 #ifndef THREAD0_STACK_SIZE
   #error "THREAD0_STACK_SIZE must be defined"
@@ -78,63 +140,73 @@
   #error "THREAD0_STACK_SIZE is less than minimum size"
 #endif
 
-#if (MAX_THREADS >= 2) && !defined(THREAD1_STACK_SIZE)
+#if (STATIC_THREADS >= 2) && !defined(THREAD1_STACK_SIZE)
   #error "THREAD1_STACK_SIZE must be defined"
-#elif THREAD1_STACK_SIZE < MIN_STACK_SIZE
+#elif (STATIC_THREADS >= 2) && (THREAD1_STACK_SIZE < MIN_STACK_SIZE)
   #error "THREAD1_STACK_SIZE is less than minimum size"
 #endif
 
-#if (MAX_THREADS >= 3) && !defined(THREAD2_STACK_SIZE)
+#if (STATIC_THREADS >= 3) && !defined(THREAD2_STACK_SIZE)
   #error "THREAD2_STACK_SIZE must be defined"
-#elif THREAD2_STACK_SIZE < MIN_STACK_SIZE
+#elif (STATIC_THREADS >= 3) && (THREAD2_STACK_SIZE < MIN_STACK_SIZE)
   #error "THREAD2_STACK_SIZE is less than minimum size"
 #endif
 
-#if (MAX_THREADS >= 4) && !defined(THREAD3_STACK_SIZE)
+#if (STATIC_THREADS >= 4) && !defined(THREAD3_STACK_SIZE)
   #error "THREAD3_STACK_SIZE must be defined"
-#elif THREAD3_STACK_SIZE < MIN_STACK_SIZE
+#elif (STATIC_THREADS >= 4) && (THREAD3_STACK_SIZE < MIN_STACK_SIZE)
   #error "THREAD3_STACK_SIZE is less than minimum size"
 #endif
 
-#if (MAX_THREADS >= 5) && !defined(THREAD4_STACK_SIZE)
+#if (STATIC_THREADS >= 5) && !defined(THREAD4_STACK_SIZE)
   #error "THREAD4_STACK_SIZE must be defined"
-#elif THREAD4_STACK_SIZE < MIN_STACK_SIZE
+#elif (STATIC_THREADS >= 5) && (THREAD4_STACK_SIZE < MIN_STACK_SIZE)
   #error "THREAD4_STACK_SIZE is less than minimum size"
 #endif
 
-#if (MAX_THREADS >= 6) && !defined(THREAD5_STACK_SIZE)
+#if (STATIC_THREADS >= 6) && !defined(THREAD5_STACK_SIZE)
   #error "THREAD5_STACK_SIZE must be defined"
-#elif THREAD5_STACK_SIZE < MIN_STACK_SIZE
+#elif (STATIC_THREADS >= 6) && (THREAD5_STACK_SIZE < MIN_STACK_SIZE)
   #error "THREAD5_STACK_SIZE is less than minimum size"
 #endif
 
-#if (MAX_THREADS >= 7) && !defined(THREAD6_STACK_SIZE)
+#if (STATIC_THREADS >= 7) && !defined(THREAD6_STACK_SIZE)
   #error "THREAD6_STACK_SIZE must be defined"
-#elif THREAD6_STACK_SIZE < MIN_STACK_SIZE
+#elif (STATIC_THREADS >= 7) && (THREAD6_STACK_SIZE < MIN_STACK_SIZE)
   #error "THREAD6_STACK_SIZE is less than minimum size"
 #endif
 
-#if (MAX_THREADS == 8) && !defined(THREAD7_STACK_SIZE)
+#if (STATIC_THREADS == 8) && !defined(THREAD7_STACK_SIZE)
   #error "THREAD7_STACK_SIZE must be defined"
-#elif THREAD7_STACK_SIZE < MIN_STACK_SIZE
+#elif (STATIC_THREADS == 8) && (THREAD7_STACK_SIZE < MIN_STACK_SIZE)
   #error "THREAD7_STACK_SIZE is less than minimum size"
 #endif
 
+// the pool must hold at least one stack
+#if defined(KERNEL_USE_STACK_POOL) && !defined(STACK_POOL_SIZE)
+  #error "KERNEL_USE_STACK_POOL defined but STACK_POOL_SIZE undefined"
+#elif defined(KERNEL_USE_STACK_POOL) && (STACK_POOL_SIZE < MIN_STACK_SIZE)
+  #error "STACK_POOL_SIZE is less than minimum stack size"
+#endif
+
 /******************************************************************************
  * Stack definitions
  *****************************************************************************/
 
 /** \def TOTAL_STACK_SIZE
- * Sums up the total stack usage for all of the user threads.
+ * Sums up the total stack usage for all of the user threads, including the 
+ * stack pool if \ref KERNEL_USE_STACK_POOL is defined.
  * \see stack_size
  * \ingroup kernel_implementation
  */
-#if MAX_THREADS == 1
+#if defined(KERNEL_USE_STACK_POOL)
+  #define TOTAL_STACK_SIZE (THREAD0_STACK_SIZE + STACK_POOL_SIZE)
+#elif MAX_THREADS == 1
   #define TOTAL_STACK_SIZE THREAD0_STACK_SIZE
 #elif MAX_THREADS == 2
   #define TOTAL_STACK_SIZE (THREAD0_STACK_SIZE + THREAD1_STACK_SIZE)
 #elif MAX_THREADS == 3
-  #define TOTAL_STACK_SIZE (THREAD0_STACK_SIZE + THREAD1_STACK_SIZE \
+  #define TOTAL_STACK_SIZE (THREAD0_STACK_SIZE + THREAD1_STACK_SIZE + \
     THREAD2_STACK_SIZE)
 #elif MAX_THREADS == 4
   #define TOTAL_STACK_SIZE (THREAD0_STACK_SIZE + THREAD1_STACK_SIZE + \
@@ -180,7 +252,7 @@
  * \ingroup kernel_implementation
  */
 #define THREAD0_STACK_BASE STACK_CAST(RAMEND)
-#if MAX_THREADS >= 2
+#if STATIC_THREADS >= 2
   /**
    * Sets the starting address of the stack for \c THREAD1.
    * \ingroup kernel_implementation
@@ -188,7 +260,7 @@
   #define THREAD1_STACK_BASE \
     STACK_CAST(THREAD0_STACK_BASE - THREAD0_STACK_SIZE)
 #endif
-#if MAX_THREADS >= 3
+#if STATIC_THREADS >= 3
   /**
    * Sets the starting address of the stack for \c THREAD2.
    * \ingroup kernel_implementation
@@ -196,7 +268,7 @@
   #define THREAD2_STACK_BASE \
     STACK_CAST(THREAD1_STACK_BASE - THREAD1_STACK_SIZE)
 #endif
-#if MAX_THREADS >= 4
+#if STATIC_THREADS >= 4
   /**
    * Sets the starting address of the stack for \c THREAD3.
    * \ingroup kernel_implementation
@@ -204,7 +276,7 @@
   #define THREAD3_STACK_BASE \
     STACK_CAST(THREAD2_STACK_BASE - THREAD2_STACK_SIZE)
 #endif
-#if MAX_THREADS >= 5
+#if STATIC_THREADS >= 5
   /**
    * Sets the starting address of the stack for \c THREAD4.
    * \ingroup kernel_implementation
@@ -212,7 +284,7 @@
   #define THREAD4_STACK_BASE \
     STACK_CAST(THREAD3_STACK_BASE - THREAD3_STACK_SIZE)
 #endif
-#if MAX_THREADS >= 6
+#if STATIC_THREADS >= 6
   /**
    * Sets the starting address of the stack for \c THREAD5.
    * \ingroup kernel_implementation
@@ -220,7 +292,7 @@
   #define THREAD5_STACK_BASE \
     STACK_CAST(THREAD4_STACK_BASE - THREAD4_STACK_SIZE)
 #endif
-#if MAX_THREADS >= 7
+#if STATIC_THREADS >= 7
   /**
    * Sets the starting address of the stack for \c THREAD6.
    * \ingroup kernel_implementation
@@ -228,7 +300,7 @@
   #define THREAD6_STACK_BASE \
     STACK_CAST(THREAD5_STACK_BASE - THREAD5_STACK_SIZE)
 #endif
-#if MAX_THREADS == 8
+#if STATIC_THREADS == 8
   /**
    * Sets the starting address of the stack for \c THREAD7.
    * \ingroup kernel_implementation
@@ -237,64 +309,143 @@
     STACK_CAST(THREAD6_STACK_BASE - THREAD6_STACK_SIZE)
 #endif
 
+/**
+ * Sets the lowest value that the stack pointer may take for \c THREAD0.  
+ * This is the topmost byte of the guard zone, or the base of the next stack 
+ * if canaries are disabled.
+ * \ingroup kernel_implementation
+ */
+#define THREAD0_STACK_LIMIT \
+  STACK_CAST(THREAD0_STACK_BASE - THREAD0_STACK_SIZE + GUARD_ZONE_SIZE)
+#if STATIC_THREADS >= 2
+  /**
+   * Sets the lowest value that the stack pointer may take for \c THREAD1.  
+   * This is the topmost byte of the guard zone, or the base of the next stack 
+   * if canaries are disabled.
+   * \ingroup kernel_implementation
+   */
+  #define THREAD1_STACK_LIMIT \
+    STACK_CAST(THREAD1_STACK_BASE - THREAD1_STACK_SIZE + GUARD_ZONE_SIZE)
+#endif
+#if STATIC_THREADS >= 3
+  /**
+   * Sets the lowest value that the stack pointer may take for \c THREAD2.  
+   * This is the topmost byte of the guard zone, or the base of the next stack 
+   * if canaries are disabled.
+   * \ingroup kernel_implementation
+   */
+  #define THREAD2_STACK_LIMIT \
+    STACK_CAST(THREAD2_STACK_BASE - THREAD2_STACK_SIZE + GUARD_ZONE_SIZE)
+#endif
+#if STATIC_THREADS >= 4
+  /**
+   * Sets the lowest value that the stack pointer may take for \c THREAD3.  
+   * This is the topmost byte of the guard zone, or the base of the next stack 
+   * if canaries are disabled.
+   * \ingroup kernel_implementation
+   */
+  #define THREAD3_STACK_LIMIT \
+    STACK_CAST(THREAD3_STACK_BASE - THREAD3_STACK_SIZE + GUARD_ZONE_SIZE)
+#endif
+#if STATIC_THREADS >= 5
+  /**
+   * Sets the lowest value that the stack pointer may take for \c THREAD4.  
+   * This is the topmost byte of the guard zone, or the base of the next stack 
+   * if canaries are disabled.
+   * \ingroup kernel_implementation
+   */
+  #define THREAD4_STACK_LIMIT \
+    STACK_CAST(THREAD4_STACK_BASE - THREAD4_STACK_SIZE + GUARD_ZONE_SIZE)
+#endif
+#if STATIC_THREADS >= 6
+  /**
+   * Sets the lowest value that the stack pointer may take for \c THREAD5.  
+   * This is the topmost byte of the guard zone, or the base of the next stack 
+   * if canaries are disabled.
+   * \ingroup kernel_implementation
+   */
+  #define THREAD5_STACK_LIMIT \
+    STACK_CAST(THREAD5_STACK_BASE - THREAD5_STACK_SIZE + GUARD_ZONE_SIZE)
+#endif
+#if STATIC_THREADS >= 7
+  /**
+   * Sets the lowest value that the stack pointer may take for \c THREAD6.  
+   * This is the topmost byte of the guard zone, or the base of the next stack 
+   * if canaries are disabled.
+   * \ingroup kernel_implementation
+   */
+  #define THREAD6_STACK_LIMIT \
+    STACK_CAST(THREAD6_STACK_BASE - THREAD6_STACK_SIZE + GUARD_ZONE_SIZE)
+#endif
+#if STATIC_THREADS == 8
+  /**
+   * Sets the lowest value that the stack pointer may take for \c THREAD7.  
+   * This is the topmost byte of the guard zone, or the base of the next stack 
+   * if canaries are disabled.
+   * \ingroup kernel_implementation
+   */
+  #define THREAD7_STACK_LIMIT \
+    STACK_CAST(THREAD7_STACK_BASE - THREAD7_STACK_SIZE + GUARD_ZONE_SIZE)
+#endif
+
 #ifdef KERNEL_USE_STACK_CANARY
   /**
-   * Sets pointer to the stack canary for \c THREAD0.
+   * Sets pointer to the bottom of the guard zone for \c THREAD0.
    * \ingroup kernel_implementation
    */
   #define THREAD0_CANARY_LOC \
     STACK_CAST(THREAD0_STACK_BASE - THREAD0_STACK_SIZE + 1)
-  #if MAX_THREADS >= 2
+  #if STATIC_THREADS >= 2
     /**
-     * Sets pointer to the stack canary for \c THREAD1.
+     * Sets pointer to the bottom of the guard zone for \c THREAD1.
      * \ingroup kernel_implementation
      */
     #define THREAD1_CANARY_LOC \
       STACK_CAST(THREAD1_STACK_BASE - THREAD1_STACK_SIZE + 1)
   #endif
-  #if MAX_THREADS >= 3
+  #if STATIC_THREADS >= 3
     /**
-     * Sets pointer to the stack canary for \c THREAD2.
+     * Sets pointer to the bottom of the guard zone for \c THREAD2.
      * \ingroup kernel_implementation
      */
     #define THREAD2_CANARY_LOC \
       STACK_CAST(THREAD2_STACK_BASE - THREAD2_STACK_SIZE + 1)
   #endif
-  #if MAX_THREADS >= 4
+  #if STATIC_THREADS >= 4
     /**
-     * Sets pointer to the stack canary for \c THREAD3.
+     * Sets pointer to the bottom of the guard zone for \c THREAD3.
      * \ingroup kernel_implementation
      */
     #define THREAD3_CANARY_LOC \
       STACK_CAST(THREAD3_STACK_BASE - THREAD3_STACK_SIZE + 1)
   #endif
-  #if MAX_THREADS >= 5
+  #if STATIC_THREADS >= 5
     /**
-     * Sets pointer to the stack canary for \c THREAD4.
+     * Sets pointer to the bottom of the guard zone for \c THREAD4.
      * \ingroup kernel_implementation
      */
     #define THREAD4_CANARY_LOC \
       STACK_CAST(THREAD4_STACK_BASE - THREAD4_STACK_SIZE + 1)
   #endif
-  #if MAX_THREADS >= 6
+  #if STATIC_THREADS >= 6
     /**
-     * Sets pointer to the stack canary for \c THREAD5.
+     * Sets pointer to the bottom of the guard zone for \c THREAD5.
      * \ingroup kernel_implementation
      */
     #define THREAD5_CANARY_LOC \
       STACK_CAST(THREAD5_STACK_BASE - THREAD5_STACK_SIZE + 1)
   #endif
-  #if MAX_THREADS >= 7
+  #if STATIC_THREADS >= 7
     /**
-     * Sets pointer to the stack canary for \c THREAD6.
+     * Sets pointer to the bottom of the guard zone for \c THREAD6.
      * \ingroup kernel_implementation
      */
     #define THREAD6_CANARY_LOC \
       STACK_CAST(THREAD6_STACK_BASE - THREAD6_STACK_SIZE + 1)
   #endif
-  #if MAX_THREADS == 8
+  #if STATIC_THREADS == 8
     /**
-     * Sets pointer to the stack canary for \c THREAD7.
+     * Sets pointer to the bottom of the guard zone for \c THREAD7.
      * \ingroup kernel_implementation
      */
     #define THREAD7_CANARY_LOC \
@@ -302,4 +453,19 @@
   #endif
 #endif
 
-#endif
\ No newline at end of file
+#ifdef KERNEL_USE_STACK_POOL
+  /**
+   * The highest address of the stack pool, which lies just below the stack of 
+   * \c THREAD0.
+   * \ingroup kernel_implementation
+   */
+  #define STACK_POOL_TOP \
+    STACK_CAST(THREAD0_STACK_BASE - THREAD0_STACK_SIZE)
+  /**
+   * The lowest address of the stack pool.
+   * \ingroup kernel_implementation
+   */
+  #define STACK_POOL_BOTTOM STACK_CAST(STACK_POOL_TOP - STACK_POOL_SIZE + 1)
+#endif
+
+#endif
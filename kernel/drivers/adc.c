@@ -0,0 +1,257 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Implements the ADC driver.
+ * \see kernel_adc
+ */
+
+#include "kernel.h"
+#include "kernel_adc.h"
+#include "kernel_debug.h"
+#include "config.h"
+#include "kernel_atomic.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#if (ADC_BLOCK_SIZE < 1) || (ADC_BLOCK_SIZE > 255)
+  #error "ADC_BLOCK_SIZE must be in the range [1,255]"
+#endif
+
+// the smallest prescaler that keeps the ADC clock at or below 200 kHz
+/** \cond */
+#if (F_CPU / 2) <= 200000
+  #define ADC_PRESCALER _BV(ADPS0)
+#elif (F_CPU / 4) <= 200000
+  #define ADC_PRESCALER _BV(ADPS1)
+#elif (F_CPU / 8) <= 200000
+  #define ADC_PRESCALER (_BV(ADPS1) | _BV(ADPS0))
+#elif (F_CPU / 16) <= 200000
+  #define ADC_PRESCALER _BV(ADPS2)
+#elif (F_CPU / 32) <= 200000
+  #define ADC_PRESCALER (_BV(ADPS2) | _BV(ADPS0))
+#elif (F_CPU / 64) <= 200000
+  #define ADC_PRESCALER (_BV(ADPS2) | _BV(ADPS1))
+#else
+  #define ADC_PRESCALER (_BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0))
+#endif
+/** \endcond */
+
+/**
+ * \addtogroup kernel_implementation
+ * @{
+ */
+
+/** Marks that no buffer is ready or held. */
+#define ADC_NO_BUFFER 0xFF
+
+/** The sample buffers. */
+static uint16_t kn_adc_buffers[2][ADC_BLOCK_SIZE];
+/** The channel list being sampled. */
+static const uint8_t* kn_adc_channels;
+/** The number of channels in the list. */
+static uint8_t kn_adc_count;
+/** The \c REFS bits for \c ADMUX. */
+static uint8_t kn_adc_reference;
+/** The index in the channel list of the next conversion. */
+static uint8_t kn_adc_channel;
+/** The number of samples in a block. */
+static uint8_t kn_adc_block_len;
+/** The buffer being filled by the interrupt. */
+static uint8_t kn_adc_fill;
+/** The index in the buffer being filled of the next sample. */
+static uint8_t kn_adc_index;
+/** The full buffer waiting to be collected, or \ref ADC_NO_BUFFER. */
+static volatile uint8_t kn_adc_ready;
+/** The buffer held by the collecting thread, or \ref ADC_NO_BUFFER. */
+static volatile uint8_t kn_adc_held = ADC_NO_BUFFER;
+/** The number of dropped blocks. */
+static volatile uint8_t kn_adc_overrun_count;
+/** True while sampling. */
+static volatile bool kn_adc_running;
+/** The thread waiting for a block. */
+static wait_list kn_adc_waiters;
+
+/**
+ * Selects the channel for the next conversion.
+ */
+static void kn_adc_select(const uint8_t channel);
+
+/**
+ * @}
+ */
+
+void kn_adc_select(const uint8_t channel)
+{
+  ADMUX = kn_adc_reference | (channel & 0x1F);
+  #ifdef MUX5
+  if (channel & 0x20)
+  {
+    ADCSRB |= _BV(MUX5);
+  }
+  else
+  {
+    ADCSRB &= ~_BV(MUX5);
+  }
+  #endif
+}
+
+void kn_adc_start(const uint8_t* channels, const uint8_t count,
+                  const uint8_t reference, const uint16_t sample_rate)
+{
+  kn_assert(channels != NULL);
+  kn_assert(count > 0 && count <= ADC_BLOCK_SIZE);
+  kn_assert(sample_rate > 0);
+  kn_assert(F_CPU / 8 / sample_rate <= 0x10000);
+  
+  kn_adc_stop();
+  
+  KN_ATOMIC_BLOCK
+  {
+    kn_adc_channels = channels;
+    kn_adc_count = count;
+    kn_adc_reference = reference & (_BV(REFS1) | _BV(REFS0));
+    kn_adc_channel = 0;
+    kn_adc_block_len = (ADC_BLOCK_SIZE / count) * count;
+    // don't fill the buffer that the thread may still be using
+    kn_adc_fill = (kn_adc_held == 0) ? 1 : 0;
+    kn_adc_index = 0;
+    kn_adc_ready = ADC_NO_BUFFER;
+    kn_adc_running = true;
+    
+    kn_adc_select(channels[0]);
+    ADCSRB = (ADCSRB & ~(_BV(ADTS2) | _BV(ADTS1) | _BV(ADTS0))) | 
+      _BV(ADTS2) | _BV(ADTS0);
+    ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIF) | _BV(ADIE) | ADC_PRESCALER;
+    
+    // Timer1 in CTC mode with a prescaler of 8, compare match B triggers 
+    // the ADC
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    OCR1A = (uint16_t)(F_CPU / 8 / sample_rate - 1);
+    OCR1B = OCR1A;
+    TIFR1 = _BV(OCF1B);
+    TCCR1B = _BV(WGM12) | _BV(CS11);
+  }
+}
+
+void kn_adc_stop()
+{
+  KN_ATOMIC_BLOCK
+  {
+    TCCR1B = 0;
+    ADCSRA = _BV(ADIF);
+    kn_adc_running = false;
+    kn_adc_ready = ADC_NO_BUFFER;
+    kn_signal_all(&kn_adc_waiters);
+  }
+}
+
+const uint16_t* kn_adc_wait_block(uint8_t* len, const uint16_t timeout)
+{
+  kn_assert(len != NULL);
+  
+  const uint16_t* block = NULL;
+  
+  KN_ATOMIC_BLOCK
+  {
+    // the previous block is no longer in use
+    kn_adc_held = ADC_NO_BUFFER;
+    
+    while (kn_adc_running && kn_adc_ready == ADC_NO_BUFFER)
+    {
+      if (!kn_wait(&kn_adc_waiters, timeout))
+      {
+        break;
+      }
+    }
+    
+    if (kn_adc_ready != ADC_NO_BUFFER)
+    {
+      kn_adc_held = kn_adc_ready;
+      kn_adc_ready = ADC_NO_BUFFER;
+      block = kn_adc_buffers[kn_adc_held];
+      *len = kn_adc_block_len;
+    }
+  }
+  
+  return block;
+}
+
+uint8_t kn_adc_overruns()
+{
+  uint8_t count;
+  
+  KN_ATOMIC_BLOCK
+  {
+    count = kn_adc_overrun_count;
+    kn_adc_overrun_count = 0;
+  }
+  
+  return count;
+}
+
+/******************************************************************************
+ * Interrupts
+ *****************************************************************************/
+
+/** \cond */
+ISR(ADC_vect)
+{
+  kn_adc_buffers[kn_adc_fill][kn_adc_index++] = ADC;
+  
+  // the trigger flag must be cleared for the next trigger, as there is no 
+  // interrupt to do it
+  TIFR1 = _BV(OCF1B);
+  
+  if (++kn_adc_channel == kn_adc_count)
+  {
+    kn_adc_channel = 0;
+  }
+  // takes effect when the next conversion starts
+  kn_adc_select(kn_adc_channels[kn_adc_channel]);
+  
+  if (kn_adc_index < kn_adc_block_len)
+  {
+    return;
+  }
+  
+  kn_adc_index = 0;
+  uint8_t other = kn_adc_fill ^ 1;
+  
+  if (other == kn_adc_held || kn_adc_ready != ADC_NO_BUFFER)
+  {
+    if (kn_adc_overrun_count < 0xFF)
+    {
+      kn_adc_overrun_count++;
+    }
+  }
+  
+  // if the thread is still using the other buffer, this block is dropped and 
+  // the buffer is filled again, otherwise an uncollected block is replaced 
+  // by the newer one
+  if (other != kn_adc_held)
+  {
+    kn_adc_ready = kn_adc_fill;
+    kn_adc_fill = other;
+    kn_signal(&kn_adc_waiters);
+  }
+}
+/** \endcond */
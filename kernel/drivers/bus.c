@@ -0,0 +1,103 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Implements the transfer queue shared by the bus drivers.
+ * \see kernel_bus
+ */
+
+#include "kernel.h"
+#include "kernel_debug.h"
+#include "bus.h"
+#include "kernel_atomic.h"
+
+bool kn_bus_enqueue(bus_queue* queue, bus_transfer* transfer)
+{
+  kn_assert(transfer != NULL);
+  
+  transfer->next = NULL;
+  transfer->status = BUS_PENDING;
+  transfer->waiter = 0;
+  
+  if (queue->head == NULL)
+  {
+    queue->head = transfer;
+    queue->tail = transfer;
+    return true;
+  }
+  
+  queue->tail->next = transfer;
+  queue->tail = transfer;
+  return false;
+}
+
+bus_transfer* kn_bus_complete(bus_queue* queue, const bus_status status)
+{
+  bus_transfer* done = queue->head;
+  
+  queue->head = done->next;
+  if (queue->head == NULL)
+  {
+    queue->tail = NULL;
+  }
+  
+  done->status = status;
+  kn_signal(&done->waiter);
+  
+  return queue->head;
+}
+
+bus_status kn_bus_wait(bus_queue* queue, bus_transfer* transfer, 
+                       const uint16_t timeout, bus_abort_ptr abort)
+{
+  kn_assert(transfer != NULL);
+  
+  KN_ATOMIC_BLOCK
+  {
+    while (transfer->status == BUS_PENDING)
+    {
+      if (!kn_wait(&transfer->waiter, timeout) && 
+          (transfer->status == BUS_PENDING))
+      {
+        // timed out, so take the transfer back from the driver
+        if (transfer == queue->head)
+        {
+          // completes the transfer and starts the next one
+          abort();
+        }
+        else
+        {
+          bus_transfer* prev = queue->head;
+          while (prev->next != transfer)
+          {
+            prev = prev->next;
+          }
+          prev->next = transfer->next;
+          if (queue->tail == transfer)
+          {
+            queue->tail = prev;
+          }
+          transfer->status = BUS_CANCELLED;
+        }
+      }
+    }
+  }
+  
+  return transfer->status;
+}
@@ -0,0 +1,87 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Transfer queue shared by the bus drivers.
+ * \see kernel_bus
+ */
+
+#ifndef BUS_H_
+#define BUS_H_
+
+#include "kernel_bus.h"
+
+/**
+ * \addtogroup kernel_implementation
+ * @{
+ */
+
+/** 
+ * A queue of bus transfers.  The transfer at the head of the queue is the one 
+ * in progress.
+ */
+typedef struct
+{
+  /** The transfer in progress, or \c NULL if the bus is idle. */
+  bus_transfer* head;
+  /** The last queued transfer. */
+  bus_transfer* tail;
+} bus_queue;
+
+/**
+ * The function type used to stop the transfer in progress on a bus, when its 
+ * wait times out.  Called with interrupts disabled, and must complete the 
+ * transfer with \ref kn_bus_complete.
+ */
+typedef void (*bus_abort_ptr)();
+
+/**
+ * Adds a transfer to the end of a queue.  Must be called with interrupts 
+ * disabled.
+ * 
+ * \return True if the bus was idle, in which case the caller must start the 
+ * transfer.
+ */
+extern bool kn_bus_enqueue(bus_queue* queue, bus_transfer* transfer);
+
+/**
+ * Completes the transfer at the head of a queue and wakes its waiter.  Must 
+ * be called with interrupts disabled.
+ * 
+ * \return The next transfer to start, or \c NULL if the queue is empty.
+ */
+extern bus_transfer* kn_bus_complete(bus_queue* queue, 
+                                     const bus_status status);
+
+/**
+ * Waits for a transfer to complete, and cancels it if the timeout expires.
+ * 
+ * \param[in] abort Stops the transfer if it is in progress when the timeout 
+ * expires.
+ * 
+ * \return The final state of the transfer.
+ */
+extern bus_status kn_bus_wait(bus_queue* queue, bus_transfer* transfer, 
+                              const uint16_t timeout, bus_abort_ptr abort);
+
+/**
+ * @}
+ */
+
+#endif
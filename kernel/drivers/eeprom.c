@@ -0,0 +1,305 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Implements the EEPROM driver.
+ * \see kernel_eeprom
+ */
+
+#include "kernel.h"
+#include "kernel_eeprom.h"
+#include "kernel_debug.h"
+#include "config.h"
+#include "kernel_atomic.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#if (EEPROM_CACHE_SIZE < 2) || (EEPROM_CACHE_SIZE > 128) || \
+  (EEPROM_CACHE_SIZE & (EEPROM_CACHE_SIZE - 1))
+  #error "EEPROM_CACHE_SIZE must be a power of 2 in the range [2,128]"
+#endif
+
+/**
+ * \addtogroup kernel_implementation
+ * @{
+ */
+
+/**
+ * A byte waiting to be written to the EEPROM.
+ */
+typedef struct
+{
+  /** The EEPROM address. */
+  uint16_t address;
+  /** The value to write. */
+  uint8_t value;
+} eeprom_entry;
+
+// the cache indexes run freely, and are masked when used
+// head - tail is the number of bytes in the cache
+
+/** Holds bytes waiting to be written. */
+static eeprom_entry kn_eeprom_cache[EEPROM_CACHE_SIZE];
+/** Index where the next written byte is stored. */
+static volatile uint8_t kn_eeprom_head;
+/** Index of the next byte that the interrupt will write. */
+static volatile uint8_t kn_eeprom_tail;
+/** The number of threads reading, which holds off new EEPROM writes. */
+static volatile uint8_t kn_eeprom_readers;
+/** Threads waiting for the write in progress to finish so they can read. */
+static wait_list kn_eeprom_read_waiters;
+/** Threads waiting for space in the cache. */
+static wait_list kn_eeprom_write_waiters;
+/** Threads waiting for the cache to empty. */
+static wait_list kn_eeprom_flush_waiters;
+
+/**
+ * Finds an address in the cache.  Must be called with interrupts disabled.
+ * 
+ * \return The cache entry, or \c NULL if the address is not cached.
+ */
+static eeprom_entry* kn_eeprom_find(const uint16_t address);
+
+/**
+ * Reads a byte from the EEPROM.  Must be called with interrupts disabled, and 
+ * with no write in progress.
+ */
+static inline uint8_t kn_eeprom_read_hw(const uint16_t address)
+{
+  EEAR = address;
+  EECR |= _BV(EERE);
+  return EEDR;
+}
+
+/**
+ * Holds off new EEPROM writes, and waits for the write in progress to finish.
+ * Must be called with interrupts disabled.
+ */
+static void kn_eeprom_begin_read();
+
+/**
+ * Allows EEPROM writes after \ref kn_eeprom_begin_read.  Must be called with 
+ * interrupts disabled.
+ */
+static void kn_eeprom_end_read();
+
+/**
+ * @}
+ */
+
+eeprom_entry* kn_eeprom_find(const uint16_t address)
+{
+  for (uint8_t i = kn_eeprom_tail; i != kn_eeprom_head; i++)
+  {
+    eeprom_entry* entry = &kn_eeprom_cache[i & (EEPROM_CACHE_SIZE - 1)];
+    if (entry->address == address)
+    {
+      return entry;
+    }
+  }
+  
+  return NULL;
+}
+
+void kn_eeprom_begin_read()
+{
+  kn_eeprom_readers++;
+  
+  while (EECR & _BV(EEPE))
+  {
+    // the ready interrupt sees the reader and wakes it instead of writing
+    EECR |= _BV(EERIE);
+    kn_wait(&kn_eeprom_read_waiters, KN_WAIT_FOREVER);
+  }
+}
+
+void kn_eeprom_end_read()
+{
+  if (--kn_eeprom_readers == 0 && kn_eeprom_head != kn_eeprom_tail)
+  {
+    EECR |= _BV(EERIE);
+  }
+}
+
+uint8_t kn_eeprom_read_byte(const uint16_t address)
+{
+  kn_assert(address <= E2END);
+  
+  uint8_t value;
+  
+  KN_ATOMIC_BLOCK
+  {
+    eeprom_entry* entry = kn_eeprom_find(address);
+    if (entry)
+    {
+      value = entry->value;
+    }
+    else
+    {
+      kn_eeprom_begin_read();
+      value = kn_eeprom_read_hw(address);
+      kn_eeprom_end_read();
+    }
+  }
+  
+  return value;
+}
+
+void kn_eeprom_read(const uint16_t address, void* buffer, const uint16_t len)
+{
+  kn_assert(buffer != NULL);
+  kn_assert(len == 0 || address + len - 1 <= E2END);
+  
+  uint8_t* bytes = (uint8_t*)buffer;
+  
+  KN_ATOMIC_BLOCK
+  {
+    kn_eeprom_readers++;
+  }
+  
+  // each byte is read in its own critical section to keep interrupt latency 
+  // down, while the reader count keeps new writes from starting
+  for (uint16_t i = 0; i < len; i++)
+  {
+    bytes[i] = kn_eeprom_read_byte(address + i);
+  }
+  
+  KN_ATOMIC_BLOCK
+  {
+    kn_eeprom_end_read();
+  }
+}
+
+bool kn_eeprom_write_byte(const uint16_t address, const uint8_t value,
+                          const uint16_t timeout)
+{
+  kn_assert(address <= E2END);
+  
+  KN_ATOMIC_BLOCK
+  {
+    while (true)
+    {
+      eeprom_entry* entry = kn_eeprom_find(address);
+      if (entry)
+      {
+        entry->value = value;
+        break;
+      }
+      
+      if ((uint8_t)(kn_eeprom_head - kn_eeprom_tail) < EEPROM_CACHE_SIZE)
+      {
+        uint8_t head = kn_eeprom_head;
+        entry = &kn_eeprom_cache[head & (EEPROM_CACHE_SIZE - 1)];
+        entry->address = address;
+        entry->value = value;
+        kn_eeprom_head = head + 1;
+        
+        if (kn_eeprom_readers == 0)
+        {
+          EECR |= _BV(EERIE);
+        }
+        break;
+      }
+      
+      if (!kn_wait(&kn_eeprom_write_waiters, timeout))
+      {
+        return false;
+      }
+    }
+  }
+  
+  return true;
+}
+
+uint16_t kn_eeprom_write(const uint16_t address, const void* buffer,
+                         const uint16_t len, const uint16_t timeout)
+{
+  kn_assert(buffer != NULL);
+  
+  const uint8_t* bytes = (const uint8_t*)buffer;
+  uint16_t count = 0;
+  
+  while ((count < len) && 
+    kn_eeprom_write_byte(address + count, bytes[count], timeout))
+  {
+    count++;
+  }
+  
+  return count;
+}
+
+bool kn_eeprom_flush(const uint16_t timeout)
+{
+  KN_ATOMIC_BLOCK
+  {
+    while ((kn_eeprom_head != kn_eeprom_tail) || (EECR & _BV(EEPE)))
+    {
+      if (kn_eeprom_readers == 0)
+      {
+        EECR |= _BV(EERIE);
+      }
+      
+      if (!kn_wait(&kn_eeprom_flush_waiters, timeout))
+      {
+        return false;
+      }
+    }
+  }
+  
+  return true;
+}
+
+/******************************************************************************
+ * Interrupts
+ *****************************************************************************/
+
+/** \cond */
+ISR(EE_READY_vect)
+{
+  if (kn_eeprom_readers)
+  {
+    EECR &= ~_BV(EERIE);
+    kn_signal_all(&kn_eeprom_read_waiters);
+    return;
+  }
+  
+  // skip bytes that the EEPROM already holds, which saves both time and wear
+  while (kn_eeprom_head != kn_eeprom_tail)
+  {
+    eeprom_entry* entry = 
+      &kn_eeprom_cache[kn_eeprom_tail & (EEPROM_CACHE_SIZE - 1)];
+    kn_eeprom_tail++;
+    kn_signal(&kn_eeprom_write_waiters);
+    
+    if (kn_eeprom_read_hw(entry->address) != entry->value)
+    {
+      // EEAR is already set by the read
+      EEDR = entry->value;
+      // EEPE must be set within 4 cycles of EEMPE
+      EECR |= _BV(EEMPE);
+      EECR |= _BV(EEPE);
+      return;
+    }
+  }
+  
+  // the interrupt is level triggered, so it is disabled while idle
+  EECR &= ~_BV(EERIE);
+  kn_signal_all(&kn_eeprom_flush_waiters);
+}
+/** \endcond */
@@ -0,0 +1,186 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Implements the high resolution timer driver.
+ * \see kernel_hrtimer
+ */
+
+#include "kernel.h"
+#include "kernel_hrtimer.h"
+#include "kernel_debug.h"
+#include "config.h"
+#include "kernel_atomic.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+/**
+ * \addtogroup kernel_implementation
+ * @{
+ */
+
+/** The pending timers, in order of expiry. */
+static hrtimer* kn_hrtimer_list;
+
+/**
+ * Runs the callbacks of expired timers, and sets the compare register for the 
+ * first timer that is left.  Must be called with interrupts disabled.
+ */
+static void kn_hrtimer_update();
+
+/**
+ * The callback of \ref kn_sleep_us, which wakes the sleeping thread.
+ */
+static void kn_hrtimer_wake(void* arg);
+
+/**
+ * @}
+ */
+
+ISR(TIMER1_COMPA_vect)
+{
+  kn_hrtimer_update();
+}
+
+void kn_hrtimer_update()
+{
+  hrtimer* timer;
+  
+  while ((timer = kn_hrtimer_list) != NULL)
+  {
+    if ((int16_t)(timer->expiry - TCNT1) > 0)
+    {
+      // the compare only matches if the count has not already passed it, so 
+      // check again once it is set
+      // the stale flag is cleared first, so a match after the check is kept
+      TIFR1 = _BV(OCF1A);
+      OCR1A = timer->expiry;
+      if ((int16_t)(timer->expiry - TCNT1) > 0)
+      {
+        TIMSK1 |= _BV(OCIE1A);
+        return;
+      }
+    }
+    
+    kn_hrtimer_list = timer->next;
+    timer->pending = false;
+    timer->callback(timer->arg);
+  }
+  
+  TIMSK1 &= ~_BV(OCIE1A);
+}
+
+void kn_hrtimer_init()
+{
+  kn_hrtimer_list = NULL;
+  TIMSK1 &= ~_BV(OCIE1A);
+  
+  #ifndef CRITICAL_STATS_TIMER1
+  // normal mode, clock / 8
+  TCCR1A = 0;
+  TCCR1B = _BV(CS11);
+  #endif
+}
+
+void kn_hrtimer_start(hrtimer* timer, const uint16_t micros, 
+                      hrtimer_callback callback, void* arg)
+{
+  kn_assert(timer != NULL);
+  kn_assert(callback != NULL);
+  kn_assert(micros <= HRTIMER_MAX_US);
+  
+  uint16_t ticks = micros * HRTIMER_TICKS_PER_US;
+  
+  KN_ATOMIC_BLOCK
+  {
+    kn_assert(!timer->pending);
+    
+    uint16_t now = TCNT1;
+    timer->expiry = now + ticks;
+    timer->callback = callback;
+    timer->arg = arg;
+    timer->pending = true;
+    
+    // every pending timer expires less than half a period from now, so they 
+    // are ordered by the time remaining
+    hrtimer** link = &kn_hrtimer_list;
+    while (*link && (uint16_t)((*link)->expiry - now) <= ticks)
+    {
+      link = &(*link)->next;
+    }
+    timer->next = *link;
+    *link = timer;
+    
+    if (link == &kn_hrtimer_list)
+    {
+      kn_hrtimer_update();
+    }
+  }
+}
+
+bool kn_hrtimer_cancel(hrtimer* timer)
+{
+  kn_assert(timer != NULL);
+  
+  bool pending;
+  
+  KN_ATOMIC_BLOCK
+  {
+    pending = timer->pending;
+    if (pending)
+    {
+      hrtimer** link = &kn_hrtimer_list;
+      while (*link != timer)
+      {
+        link = &(*link)->next;
+      }
+      *link = timer->next;
+      timer->pending = false;
+      
+      if (link == &kn_hrtimer_list)
+      {
+        kn_hrtimer_update();
+      }
+    }
+  }
+  
+  return pending;
+}
+
+void kn_hrtimer_wake(void* arg)
+{
+  kn_signal((wait_list*)arg);
+}
+
+void kn_sleep_us(const uint16_t micros)
+{
+  hrtimer timer;
+  wait_list waiter = 0;
+  
+  timer.pending = false;
+  
+  KN_ATOMIC_BLOCK
+  {
+    kn_hrtimer_start(&timer, micros, &kn_hrtimer_wake, (void*)&waiter);
+    while (timer.pending)
+    {
+      kn_wait(&waiter, KN_WAIT_FOREVER);
+    }
+  }
+}
@@ -0,0 +1,229 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Implements the deferred logger.
+ * \see kernel_log
+ */
+
+#include "kernel.h"
+#include "kernel_log.h"
+#include "kernel_uart.h"
+#include "kernel_debug.h"
+#include "config.h"
+#include "kernel_atomic.h"
+
+#if (LOG_BUFFER_SIZE < 16) || (LOG_BUFFER_SIZE > 128) || \
+  (LOG_BUFFER_SIZE & (LOG_BUFFER_SIZE - 1))
+  #error "LOG_BUFFER_SIZE must be a power of 2 in the range [16,128]"
+#endif
+
+/**
+ * \addtogroup kernel_implementation
+ * @{
+ */
+
+/** Marks the start of each message sent to the host. */
+#define LOG_SYNC 0xA5
+
+/** 
+ * The size of a message header as it is sent, which carries the full time 
+ * instead of its low 16 bits.
+ */
+#define LOG_SENT_HEADER_SIZE 8
+
+// the buffer indexes run freely, and are masked when used
+// head - tail is the number of bytes in the buffer
+// each message is stored as the length of its arguments, the format address, 
+// the low 16 bits of the time, the thread id and the arguments
+
+/** Holds messages until they are sent. */
+static uint8_t kn_log_buffer[LOG_BUFFER_SIZE];
+/** Index where the next message is stored. */
+static volatile uint8_t kn_log_head;
+/** Index of the next byte to be sent. */
+static volatile uint8_t kn_log_tail;
+/** The number of messages dropped since the last report. */
+static volatile uint16_t kn_log_dropped;
+/** The thread waiting for messages. */
+static wait_list kn_log_waiters;
+
+extern thread_id kn_cur_thread;
+extern volatile uint32_t kn_system_counter;
+
+/**
+ * Stores a byte at a buffer index.
+ */
+static inline void kn_log_put(const uint8_t index, const uint8_t byte);
+
+/**
+ * Returns the byte at a buffer index.
+ */
+static inline uint8_t kn_log_get(const uint8_t index);
+
+/**
+ * Sends the sync byte and a message header with the full time.
+ */
+static void kn_log_send_header(const uint8_t len, const uint16_t fmt, 
+                               const uint32_t time, const thread_id t_id);
+
+/**
+ * @}
+ */
+
+void kn_log_put(const uint8_t index, const uint8_t byte)
+{
+  kn_log_buffer[index & (LOG_BUFFER_SIZE - 1)] = byte;
+}
+
+uint8_t kn_log_get(const uint8_t index)
+{
+  return kn_log_buffer[index & (LOG_BUFFER_SIZE - 1)];
+}
+
+void kn_log_write(const char* fmt, const void* args, const uint8_t len)
+{
+  kn_assert(len <= LOG_BUFFER_SIZE - LOG_HEADER_SIZE);
+  
+  const uint8_t* bytes = (const uint8_t*)args;
+  uint8_t size = LOG_HEADER_SIZE + len;
+  
+  KN_ATOMIC_BLOCK
+  {
+    uint8_t head = kn_log_head;
+    uint8_t used = head - kn_log_tail;
+    
+    if ((uint8_t)(LOG_BUFFER_SIZE - used) < size)
+    {
+      if (kn_log_dropped < UINT16_MAX)
+      {
+        kn_log_dropped++;
+      }
+      return;
+    }
+    
+    // the counter is read directly since interrupts are already disabled, and 
+    // only its low 16 bits are kept; kn_log_thread restores the rest
+    uint16_t now = kn_system_counter;
+    uint8_t index = head & (LOG_BUFFER_SIZE - 1);
+    
+    if ((uint8_t)(LOG_BUFFER_SIZE - index) >= size)
+    {
+      // the message does not wrap, so it is copied without masking each index
+      uint8_t* dest = &kn_log_buffer[index];
+      *dest++ = len;
+      *dest++ = (uint16_t)fmt & 0xFF;
+      *dest++ = (uint16_t)fmt >> 8;
+      *dest++ = now & 0xFF;
+      *dest++ = now >> 8;
+      *dest++ = kn_cur_thread;
+      for (uint8_t i = 0; i < len; i++)
+      {
+        *dest++ = bytes[i];
+      }
+    }
+    else
+    {
+      kn_log_put(head, len);
+      kn_log_put(head + 1, (uint16_t)fmt & 0xFF);
+      kn_log_put(head + 2, (uint16_t)fmt >> 8);
+      kn_log_put(head + 3, now & 0xFF);
+      kn_log_put(head + 4, now >> 8);
+      kn_log_put(head + 5, kn_cur_thread);
+      for (uint8_t i = 0; i < len; i++)
+      {
+        kn_log_put(head + LOG_HEADER_SIZE + i, bytes[i]);
+      }
+    }
+    kn_log_head = head + size;
+    
+    // the thread only waits while the buffer is empty
+    if (!used && kn_log_waiters)
+    {
+      kn_signal(&kn_log_waiters);
+    }
+  }
+}
+
+void kn_log_send_header(const uint8_t len, const uint16_t fmt, 
+                        const uint32_t time, const thread_id t_id)
+{
+  uint8_t header[LOG_SENT_HEADER_SIZE + 1] = {
+    LOG_SYNC, len, fmt & 0xFF, fmt >> 8, 
+    time & 0xFF, (time >> 8) & 0xFF, (time >> 16) & 0xFF, time >> 24,
+    t_id
+  };
+  
+  kn_uart_write(header, sizeof(header), KN_WAIT_FOREVER);
+}
+
+void kn_log_thread(const thread_id my_id, void* arg)
+{
+  (void)arg;
+  
+  while (1)
+  {
+    uint16_t dropped;
+    
+    KN_ATOMIC_BLOCK
+    {
+      while ((kn_log_head == kn_log_tail) && !kn_log_dropped)
+      {
+        kn_wait(&kn_log_waiters, KN_WAIT_FOREVER);
+      }
+      
+      dropped = kn_log_dropped;
+      kn_log_dropped = 0;
+    }
+    
+    // drops are reported before the messages that follow them
+    if (dropped)
+    {
+      kn_log_send_header(2, 0, kn_millis(), my_id);
+      kn_uart_putc(dropped & 0xFF, KN_WAIT_FOREVER);
+      kn_uart_putc(dropped >> 8, KN_WAIT_FOREVER);
+    }
+    
+    // the tail only moves past a whole message, so the writer can never 
+    // overwrite a message that is still being sent
+    uint8_t tail = kn_log_tail;
+    if (tail == kn_log_head)
+    {
+      continue;
+    }
+    
+    uint8_t len = kn_log_get(tail);
+    uint16_t fmt = kn_log_get(tail + 1) | (kn_log_get(tail + 2) << 8);
+    uint16_t stamp = kn_log_get(tail + 3) | (kn_log_get(tail + 4) << 8);
+    thread_id t_id = kn_log_get(tail + 5);
+    tail += LOG_HEADER_SIZE;
+    
+    // the message was written less than 65536 ms ago, so the time is the 
+    // latest one that has the same low 16 bits
+    uint32_t now = kn_millis();
+    kn_log_send_header(len, fmt, now - (uint16_t)((uint16_t)now - stamp), 
+                       t_id);
+    for (uint8_t i = 0; i < len; i++)
+    {
+      kn_uart_putc(kn_log_get(tail++), KN_WAIT_FOREVER);
+    }
+    
+    kn_log_tail = tail;
+  }
+}
@@ -0,0 +1,211 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Implements the SPI bus driver.
+ * \see kernel_bus
+ */
+
+#include "kernel.h"
+#include "kernel_bus.h"
+#include "kernel_debug.h"
+#include "bus.h"
+#include "kernel_atomic.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+// SPI pin locations
+/** \cond */
+#if defined(__AVR_ATmega640__) || defined(__AVR_ATmega1280__) || \
+  defined(__AVR_ATmega1281__) || defined(__AVR_ATmega2560__) || \
+  defined(__AVR_ATmega2561__)
+  #define SPI_SS DDB0
+  #define SPI_SCK DDB1
+  #define SPI_MOSI DDB2
+#else
+  #define SPI_SS DDB2
+  #define SPI_MOSI DDB3
+  #define SPI_SCK DDB5
+#endif
+/** \endcond */
+
+/**
+ * \addtogroup kernel_implementation
+ * @{
+ */
+
+/** The transfers waiting for the SPI bus. */
+static bus_queue kn_spi_queue;
+/** The next byte to write for the transfer in progress. */
+static const uint8_t* kn_spi_tx;
+/** The number of bytes left to write for the transfer in progress. */
+static uint8_t kn_spi_tx_left;
+/** Where the next byte read is stored for the transfer in progress. */
+static uint8_t* kn_spi_rx;
+/** The number of bytes left to read for the transfer in progress. */
+static uint8_t kn_spi_rx_left;
+/** True if the byte being shifted is part of the read. */
+static bool kn_spi_reading;
+
+/**
+ * Selects the device for a transfer and starts shifting its first byte.  
+ * Transfers with nothing to shift are completed immediately, and the next one 
+ * is started instead.
+ * 
+ * \param[in] transfer The transfer to start, or \c NULL if there is none.
+ */
+static void kn_spi_start(bus_transfer* transfer);
+
+/**
+ * Starts shifting the next byte of the transfer in progress.
+ * 
+ * \return False if the transfer has no bytes left.
+ */
+static bool kn_spi_shift_next();
+
+/**
+ * Deselects the device for the transfer in progress, completes it and starts 
+ * the next transfer.
+ */
+static void kn_spi_finish(const bus_status status);
+
+/**
+ * Stops the transfer in progress when its wait times out.
+ */
+static void kn_spi_abort();
+
+/**
+ * @}
+ */
+
+void kn_spi_start(bus_transfer* transfer)
+{
+  while (transfer)
+  {
+    kn_spi_tx = transfer->tx;
+    kn_spi_tx_left = transfer->tx_len;
+    kn_spi_rx = transfer->rx;
+    kn_spi_rx_left = transfer->rx_len;
+    
+    *transfer->cs_port &= ~transfer->address;
+    if (kn_spi_shift_next())
+    {
+      return;
+    }
+    
+    *transfer->cs_port |= transfer->address;
+    transfer = kn_bus_complete(&kn_spi_queue, BUS_DONE);
+  }
+}
+
+bool kn_spi_shift_next()
+{
+  if (kn_spi_tx_left)
+  {
+    kn_spi_tx_left--;
+    kn_spi_reading = false;
+    SPDR = *kn_spi_tx++;
+    return true;
+  }
+  
+  if (kn_spi_rx_left)
+  {
+    kn_spi_rx_left--;
+    kn_spi_reading = true;
+    SPDR = 0xFF;
+    return true;
+  }
+  
+  return false;
+}
+
+void kn_spi_finish(const bus_status status)
+{
+  bus_transfer* transfer = kn_spi_queue.head;
+  *transfer->cs_port |= transfer->address;
+  kn_spi_start(kn_bus_complete(&kn_spi_queue, status));
+}
+
+void kn_spi_abort()
+{
+  // let the byte being shifted finish, so that it is not mistaken for part 
+  // of the next transfer
+  // reading SPSR and then SPDR clears the flag
+  loop_until_bit_is_set(SPSR, SPIF);
+  (void)SPDR;
+  kn_spi_finish(BUS_CANCELLED);
+}
+
+void kn_spi_init(const uint8_t control, const bool double_speed)
+{
+  kn_spi_queue.head = NULL;
+  kn_spi_queue.tail = NULL;
+  
+  // SS must be an output to stay in master mode
+  DDRB |= _BV(SPI_SS) | _BV(SPI_MOSI) | _BV(SPI_SCK);
+  SPCR = _BV(SPIE) | _BV(SPE) | _BV(MSTR) | 
+    (control & (_BV(CPOL) | _BV(CPHA) | _BV(DORD) | _BV(SPR1) | _BV(SPR0)));
+  SPSR = double_speed ? _BV(SPI2X) : 0;
+}
+
+void kn_spi_submit(bus_transfer* transfer)
+{
+  kn_assert(transfer != NULL);
+  kn_assert(transfer->cs_port != NULL);
+  
+  KN_ATOMIC_BLOCK
+  {
+    if (kn_bus_enqueue(&kn_spi_queue, transfer))
+    {
+      kn_spi_start(transfer);
+    }
+  }
+}
+
+bus_status kn_spi_wait(bus_transfer* transfer, const uint16_t timeout)
+{
+  return kn_bus_wait(&kn_spi_queue, transfer, timeout, &kn_spi_abort);
+}
+
+bus_status kn_spi_transfer(bus_transfer* transfer, const uint16_t timeout)
+{
+  kn_spi_submit(transfer);
+  return kn_spi_wait(transfer, timeout);
+}
+
+/******************************************************************************
+ * Interrupts
+ *****************************************************************************/
+
+/** \cond */
+ISR(SPI_STC_vect)
+{
+  uint8_t data = SPDR;
+  
+  if (kn_spi_reading)
+  {
+    *kn_spi_rx++ = data;
+  }
+  
+  if (!kn_spi_shift_next())
+  {
+    kn_spi_finish(BUS_DONE);
+  }
+}
+/** \endcond */
@@ -0,0 +1,217 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Implements the TWI (I2C) bus driver.
+ * \see kernel_bus
+ */
+
+#include "kernel.h"
+#include "kernel_bus.h"
+#include "kernel_debug.h"
+#include "config.h"
+#include "bus.h"
+#include "kernel_atomic.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/twi.h>
+
+/**
+ * \addtogroup kernel_implementation
+ * @{
+ */
+
+/** 
+ * The \c TWCR value that clears the interrupt flag to continue with the next 
+ * bus operation.
+ */
+#define TWI_NEXT (_BV(TWINT) | _BV(TWEN) | _BV(TWIE))
+
+/** The transfers waiting for the TWI bus. */
+static bus_queue kn_twi_queue;
+/** The next byte to write for the transfer in progress. */
+static const uint8_t* kn_twi_tx;
+/** The number of bytes left to write for the transfer in progress. */
+static uint8_t kn_twi_tx_left;
+/** Where the next byte read is stored for the transfer in progress. */
+static uint8_t* kn_twi_rx;
+/** The number of bytes left to read for the transfer in progress. */
+static uint8_t kn_twi_rx_left;
+
+/**
+ * Loads the state for a transfer, so that it runs after the next start 
+ * condition.
+ */
+static void kn_twi_load(bus_transfer* transfer);
+
+/**
+ * Completes the transfer in progress, and starts the next queued transfer.
+ * 
+ * \param[in] status The final state of the transfer.
+ * \param[in] stop True if a stop condition should be sent.
+ */
+static void kn_twi_finish(const bus_status status, const bool stop);
+
+/**
+ * Stops the transfer in progress when its wait times out.  The bus may be 
+ * stuck, so the TWI hardware is reset instead of waiting for it.
+ */
+static void kn_twi_abort();
+
+/**
+ * @}
+ */
+
+void kn_twi_load(bus_transfer* transfer)
+{
+  kn_twi_tx = transfer->tx;
+  kn_twi_tx_left = transfer->tx_len;
+  kn_twi_rx = transfer->rx;
+  kn_twi_rx_left = transfer->rx_len;
+}
+
+void kn_twi_finish(const bus_status status, const bool stop)
+{
+  bus_transfer* next = kn_bus_complete(&kn_twi_queue, status);
+  uint8_t control = TWI_NEXT;
+  
+  if (stop)
+  {
+    control |= _BV(TWSTO);
+  }
+  // with both bits set the hardware sends a stop followed by a start, so the 
+  // next transfer begins without another trip through the queue
+  if (next)
+  {
+    kn_twi_load(next);
+    control |= _BV(TWSTA);
+  }
+  
+  TWCR = control;
+}
+
+void kn_twi_abort()
+{
+  TWCR = 0;
+  TWCR = _BV(TWEN);
+  kn_twi_finish(BUS_CANCELLED, false);
+}
+
+void kn_twi_init(const uint32_t frequency)
+{
+  kn_assert(frequency > 0);
+  
+  kn_twi_queue.head = NULL;
+  kn_twi_queue.tail = NULL;
+  
+  // prescaler of 1
+  TWSR = 0;
+  TWBR = ((F_CPU / frequency) - 16) / 2;
+  TWCR = _BV(TWEN);
+}
+
+void kn_twi_submit(bus_transfer* transfer)
+{
+  kn_assert(transfer != NULL);
+  kn_assert(transfer->address < 0x80);
+  
+  KN_ATOMIC_BLOCK
+  {
+    if (kn_bus_enqueue(&kn_twi_queue, transfer))
+    {
+      kn_twi_load(transfer);
+      TWCR = TWI_NEXT | _BV(TWSTA);
+    }
+  }
+}
+
+bus_status kn_twi_wait(bus_transfer* transfer, const uint16_t timeout)
+{
+  return kn_bus_wait(&kn_twi_queue, transfer, timeout, &kn_twi_abort);
+}
+
+bus_status kn_twi_transfer(bus_transfer* transfer, const uint16_t timeout)
+{
+  kn_twi_submit(transfer);
+  return kn_twi_wait(transfer, timeout);
+}
+
+/******************************************************************************
+ * Interrupts
+ *****************************************************************************/
+
+/** \cond */
+ISR(TWI_vect)
+{
+  switch (TW_STATUS)
+  {
+    case TW_START:
+    case TW_REP_START:
+      // the write comes first, unless there is only data to read
+      TWDR = (kn_twi_queue.head->address << 1) | 
+        ((kn_twi_tx_left || !kn_twi_rx_left) ? TW_WRITE : TW_READ);
+      TWCR = TWI_NEXT;
+      break;
+    
+    case TW_MT_SLA_ACK:
+    case TW_MT_DATA_ACK:
+      if (kn_twi_tx_left)
+      {
+        kn_twi_tx_left--;
+        TWDR = *kn_twi_tx++;
+        TWCR = TWI_NEXT;
+      }
+      else if (kn_twi_rx_left)
+      {
+        // repeated start for the read
+        TWCR = TWI_NEXT | _BV(TWSTA);
+      }
+      else
+      {
+        kn_twi_finish(BUS_DONE, true);
+      }
+      break;
+    
+    case TW_MR_DATA_ACK:
+      kn_twi_rx_left--;
+      *kn_twi_rx++ = TWDR;
+      // fall through
+    case TW_MR_SLA_ACK:
+      // acknowledge every byte except the last
+      TWCR = (kn_twi_rx_left > 1) ? (TWI_NEXT | _BV(TWEA)) : TWI_NEXT;
+      break;
+    
+    case TW_MR_DATA_NACK:
+      kn_twi_rx_left--;
+      *kn_twi_rx++ = TWDR;
+      kn_twi_finish(BUS_DONE, true);
+      break;
+    
+    case TW_MT_ARB_LOST:
+      // another master owns the bus, so no stop is sent
+      kn_twi_finish(BUS_ERROR, false);
+      break;
+    
+    default:
+      // the address or data was not acknowledged, or a bus error
+      kn_twi_finish(BUS_ERROR, true);
+      break;
+  }
+}
+/** \endcond */
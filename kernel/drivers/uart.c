@@ -0,0 +1,288 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Implements the UART driver.
+ * \see kernel_uart
+ */
+
+#include "kernel.h"
+#include "kernel_uart.h"
+#include "kernel_debug.h"
+#include "config.h"
+#include "kernel_atomic.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+#if (UART_RX_BUFFER_SIZE < 2) || (UART_RX_BUFFER_SIZE > 128) || \
+  (UART_RX_BUFFER_SIZE & (UART_RX_BUFFER_SIZE - 1))
+  #error "UART_RX_BUFFER_SIZE must be a power of 2 in the range [2,128]"
+#endif
+
+#if (UART_TX_BUFFER_SIZE < 2) || (UART_TX_BUFFER_SIZE > 128) || \
+  (UART_TX_BUFFER_SIZE & (UART_TX_BUFFER_SIZE - 1))
+  #error "UART_TX_BUFFER_SIZE must be a power of 2 in the range [2,128]"
+#endif
+
+// MCUs with more than one USART number the vectors
+/** \cond */
+#ifdef USART0_RX_vect
+  #define UART_RX_VECT USART0_RX_vect
+  #define UART_UDRE_VECT USART0_UDRE_vect
+#else
+  #define UART_RX_VECT USART_RX_vect
+  #define UART_UDRE_VECT USART_UDRE_vect
+#endif
+/** \endcond */
+
+/**
+ * \addtogroup kernel_implementation
+ * @{
+ */
+
+// the buffer indexes run freely, and are masked when used
+// head - tail is the number of bytes in the buffer
+
+/** Holds received bytes until they are read. */
+static uint8_t kn_uart_rx_buffer[UART_RX_BUFFER_SIZE];
+/** Index where the receive interrupt stores the next byte. */
+static volatile uint8_t kn_uart_rx_head;
+/** Index of the next byte to be read. */
+static volatile uint8_t kn_uart_rx_tail;
+/** Threads waiting for a byte to be received. */
+static wait_list kn_uart_rx_waiters;
+
+/** Holds bytes waiting to be transmitted. */
+static uint8_t kn_uart_tx_buffer[UART_TX_BUFFER_SIZE];
+/** Index where the next byte to be sent is stored. */
+static volatile uint8_t kn_uart_tx_head;
+/** Index of the next byte that the interrupt will send. */
+static volatile uint8_t kn_uart_tx_tail;
+/** Threads waiting for space in the transmit buffer. */
+static wait_list kn_uart_tx_waiters;
+/** Threads waiting for the transmit buffer to empty. */
+static wait_list kn_uart_flush_waiters;
+
+/**
+ * Writes a character to the UART for the stdio stream.
+ */
+static int kn_uart_stream_put(char c, FILE* stream);
+
+/**
+ * Reads a character from the UART for the stdio stream.
+ */
+static int kn_uart_stream_get(FILE* stream);
+
+/**
+ * @}
+ */
+
+FILE kn_uart_stream = 
+  FDEV_SETUP_STREAM(kn_uart_stream_put, kn_uart_stream_get, _FDEV_SETUP_RW);
+
+int kn_uart_stream_put(char c, FILE* stream)
+{
+  (void)stream;
+  kn_uart_putc(c, KN_WAIT_FOREVER);
+  return 0;
+}
+
+int kn_uart_stream_get(FILE* stream)
+{
+  (void)stream;
+  uint8_t byte;
+  kn_uart_getc(&byte, KN_WAIT_FOREVER);
+  return byte;
+}
+
+void kn_uart_init(const uint32_t baud)
+{
+  kn_assert(baud > 0);
+  
+  kn_uart_rx_head = 0;
+  kn_uart_rx_tail = 0;
+  kn_uart_tx_head = 0;
+  kn_uart_tx_tail = 0;
+  
+  // double speed mode gives a better match for the common baud rates
+  UBRR0 = ((F_CPU / 8) + (baud / 2)) / baud - 1;
+  UCSR0A = _BV(U2X0);
+  // 8 data bits, no parity, 1 stop bit
+  UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+  // the data register empty interrupt is enabled when there is data to send
+  UCSR0B = _BV(RXEN0) | _BV(TXEN0) | _BV(RXCIE0);
+}
+
+bool kn_uart_getc(uint8_t* byte, const uint16_t timeout)
+{
+  kn_assert(byte != NULL);
+  
+  KN_ATOMIC_BLOCK
+  {
+    while (kn_uart_rx_head == kn_uart_rx_tail)
+    {
+      if (!kn_wait(&kn_uart_rx_waiters, timeout))
+      {
+        return false;
+      }
+    }
+    
+    uint8_t tail = kn_uart_rx_tail;
+    *byte = kn_uart_rx_buffer[tail & (UART_RX_BUFFER_SIZE - 1)];
+    kn_uart_rx_tail = tail + 1;
+  }
+  
+  return true;
+}
+
+uint8_t kn_uart_read(void* buffer, const uint8_t len, const uint16_t timeout)
+{
+  kn_assert(buffer != NULL);
+  
+  uint8_t* bytes = (uint8_t*)buffer;
+  uint8_t count = 0;
+  
+  while ((count < len) && kn_uart_getc(&bytes[count], timeout))
+  {
+    count++;
+  }
+  
+  return count;
+}
+
+uint8_t kn_uart_available()
+{
+  return kn_uart_rx_head - kn_uart_rx_tail;
+}
+
+wait_list* kn_uart_rx_wait_list()
+{
+  return &kn_uart_rx_waiters;
+}
+
+bool kn_uart_putc(const uint8_t byte, const uint16_t timeout)
+{
+  KN_ATOMIC_BLOCK
+  {
+    while ((uint8_t)(kn_uart_tx_head - kn_uart_tx_tail) == UART_TX_BUFFER_SIZE)
+    {
+      if (!kn_wait(&kn_uart_tx_waiters, timeout))
+      {
+        return false;
+      }
+    }
+    
+    uint8_t head = kn_uart_tx_head;
+    kn_uart_tx_buffer[head & (UART_TX_BUFFER_SIZE - 1)] = byte;
+    kn_uart_tx_head = head + 1;
+    UCSR0B |= _BV(UDRIE0);
+  }
+  
+  return true;
+}
+
+uint8_t kn_uart_write(const void* buffer, const uint8_t len, 
+                      const uint16_t timeout)
+{
+  kn_assert(buffer != NULL);
+  
+  const uint8_t* bytes = (const uint8_t*)buffer;
+  uint8_t count = 0;
+  
+  while ((count < len) && kn_uart_putc(bytes[count], timeout))
+  {
+    count++;
+  }
+  
+  return count;
+}
+
+bool kn_uart_flush(const uint16_t timeout)
+{
+  KN_ATOMIC_BLOCK
+  {
+    while (kn_uart_tx_head != kn_uart_tx_tail)
+    {
+      if (!kn_wait(&kn_uart_flush_waiters, timeout))
+      {
+        return false;
+      }
+    }
+  }
+  
+  return true;
+}
+
+void kn_uart_write_polled(const char* str)
+{
+  kn_assert(str != NULL);
+  
+  // take over from the interrupt
+  UCSR0B &= ~_BV(UDRIE0);
+  
+  while (kn_uart_tx_head != kn_uart_tx_tail)
+  {
+    loop_until_bit_is_set(UCSR0A, UDRE0);
+    UDR0 = kn_uart_tx_buffer[kn_uart_tx_tail & (UART_TX_BUFFER_SIZE - 1)];
+    kn_uart_tx_tail++;
+  }
+  
+  while (*str)
+  {
+    loop_until_bit_is_set(UCSR0A, UDRE0);
+    UDR0 = *str++;
+  }
+}
+
+/******************************************************************************
+ * Interrupts
+ *****************************************************************************/
+
+/** \cond */
+ISR(UART_RX_VECT)
+{
+  // the data register must be read to clear the interrupt
+  uint8_t data = UDR0;
+  uint8_t head = kn_uart_rx_head;
+  
+  if ((uint8_t)(head - kn_uart_rx_tail) < UART_RX_BUFFER_SIZE)
+  {
+    kn_uart_rx_buffer[head & (UART_RX_BUFFER_SIZE - 1)] = data;
+    kn_uart_rx_head = head + 1;
+    kn_signal(&kn_uart_rx_waiters);
+  }
+}
+
+ISR(UART_UDRE_VECT)
+{
+  uint8_t tail = kn_uart_tx_tail;
+  
+  if (tail != kn_uart_tx_head)
+  {
+    UDR0 = kn_uart_tx_buffer[tail & (UART_TX_BUFFER_SIZE - 1)];
+    kn_uart_tx_tail = tail + 1;
+    kn_signal(&kn_uart_tx_waiters);
+  }
+  else
+  {
+    UCSR0B &= ~_BV(UDRIE0);
+    kn_signal_all(&kn_uart_flush_waiters);
+  }
+}
+/** \endcond */
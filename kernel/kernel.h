@@ -25,11 +25,29 @@
 /** \mainpage Overview
  * avr-kernel is a lightweight kernel for the AtMega328p microcontroller, 
  * capable of supporting up to 8 threads.  When compiled with full support 
- * for 8 threads, the kernel uses 41 bytes of RAM and around 1 KB of program 
+ * for 8 threads, the kernel uses 60 bytes of RAM and around 1 KB of program 
  * memory.
  * 
+ * Larger AVRs with a 22 bit program counter, such as the ATmega2560, are also 
+ * supported.  On these MCUs thread stack frames use 3 byte return addresses, 
+ * and the kernel's program memory tables are read with \c elpm.
+ * 
  * See \ref kernel_config for the user-configurable options available, and 
- * \ref kernel_interface for the main interface.
+ * \ref kernel_interface for the main interface.  Optional services that are 
+ * built on the main interface are documented in their own modules:
+ * - \ref kernel_pool
+ * - \ref kernel_uart
+ * - \ref kernel_bus
+ * - \ref kernel_adc
+ * - \ref kernel_hrtimer
+ * - \ref kernel_eeprom
+ * - \ref kernel_log
+ * - \ref kernel_edf
+ * - \ref kernel_cyclic
+ * - \ref kernel_isr
+ * - \ref kernel_seqlock
+ * - \ref kernel_atomic
+ * - \ref kernel_cpp
  * 
  * The kernel uses a fairly basic round-robin cooperative scheduler.  Each 
  * thread "owns" the processor and must yield to the kernel so that other 
@@ -38,7 +56,7 @@
  * when a thread yields to the kernel, there are no guarantees of how quickly 
  * the thread will be executed again.
  * 
- * Threads exist in one of four possible states:
+ * Threads exist in one of five possible states:
  * -# \b Disabled  The thread is totally inactive and exists in an invalid 
  *    state.  It will not execute until a new thread is created in its place.  
  *    Initially, the \c main function is entered as \c THREAD0, and all other 
@@ -48,7 +66,10 @@
  *    execution to continue.
  * -# \b Sleeping  Sleeping threads exist in a valid state, but their execution 
  *    is suspended and they will automatically be resumed by the kernel when 
- *    their sleep time is elapsed.
+ *    their sleep time is elapsed.  \ref kn_wake ends a sleep early.
+ * -# \b Blocked  The thread is waiting on a \ref wait_list for an event, such 
+ *    as data arriving in a queue.  It is resumed when the event is signaled, 
+ *    or when the timeout it waited with expires.
  * -# \b Active  A thread that is not in any of the above states is active, and 
  *    will be executed by the kernel scheduler.
  * 
@@ -59,6 +80,14 @@
  * will need to include \c core/stacks.h, and set <tt>__malloc_heap_end = 
  * RAMEND - TOTAL_STACK_SIZE</tt> early in your program initialization 
  * (see http://www.nongnu.org/avr-libc/user-manual/malloc.html).
+ * Alternatively, if \ref KERNEL_USE_STACK_POOL is defined, the stacks of all 
+ * threads but \c THREAD0 are allocated from a shared pool when the threads 
+ * are created, so that the same RAM can serve different sets of threads.
+ * 
+ * Every blocking operation in the kernel takes a timeout in milliseconds 
+ * (\ref KN_WAIT_FOREVER to wait without limit) and reports whether it timed 
+ * out.  They are all built on \ref kn_wait, which uses the same per-thread 
+ * counter as \ref kn_sleep for the timeout.
  * 
  * Kernel initialization occurs automatically before \c main is called.  The 
  * only user action necessary is to enable interrupts, as the kernel uses 
@@ -74,6 +103,11 @@
 #define KERNEL_H_
 
 #include "kernel_types.h"
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /**
  * \defgroup kernel_interface Kernel Interface
@@ -97,6 +131,34 @@
  */
 extern void kn_create_thread(const thread_id t_id, thread_ptr entry_point, 
                              const bool suspended, void* arg);
+#ifdef KERNEL_USE_STACK_POOL
+/**
+ * Creates a new thread with a stack allocated from the stack pool.  The stack 
+ * returns to the pool when the thread is disabled, including when its entry 
+ * point returns.  A thread that is replaced by this function gives up its old 
+ * stack.
+ * 
+ * \ref kn_create_thread may still be used for \c THREAD0, and for a thread 
+ * that is enabled, which keeps its stack.
+ * 
+ * \param[in] t_id The id of the new thread.  May not be \c THREAD0 or the 
+ * calling thread.
+ * \param[in] entry_point The function that will be run as the new thread.
+ * \param[in] suspended The initial state of the new thread. If true, the 
+ * thread will not run until it is manually resumed.
+ * \param[in] arg The parameter that will be passed to the function.
+ * \param[in] stack_size The size of the thread's stack, including the guard 
+ * zone.  Must be at least \ref MIN_STACK_SIZE.
+ * 
+ * \return False if the pool did not have room for the stack, in which case 
+ * no thread was changed.
+ */
+extern bool kn_create_pooled_thread(const thread_id t_id, 
+                                    thread_ptr entry_point, 
+                                    const bool suspended, void* arg,
+                                    const uint16_t stack_size);
+#endif
+
 /**
  * Replaces the calling thread with a new thread. Basically is just a wrapper 
  * for the \ref kn_create_thread that automatically supplies the id of the 
@@ -114,6 +176,15 @@ static inline void kn_replace_self(thread_ptr entry_point, const bool suspended,
  */
 extern void kn_yield();
 
+/**
+ * Yields only if another thread is ready to run.  Otherwise returns after
+ * about 20 cycles plus the call, without saving the thread's state.  Meant for
+ * frequent use in long running computations.
+ * 
+ * \note Unlike \ref kn_yield, does not check the calling thread's stack.
+ */
+extern void kn_yield_if_needed();
+
 /**
  * Allows a thread to sleep for a certain amount of time. For sleep times 
  * longer than 65 seconds, use \ref kn_sleep_long.
@@ -130,6 +201,176 @@ extern void kn_sleep(const uint16_t millis);
  */
 extern void kn_sleep_long(uint32_t millis);
 
+/**
+ * Ends the sleep of the specified thread early.  If the thread is blocked with 
+ * a timeout, the wait ends as though the timeout had expired.  Has no effect 
+ * if the thread is not sleeping.  May be called from an interrupt.
+ */
+extern void kn_wake(const thread_id t_id);
+
+/**
+ * Blocks the calling thread on a wait list until the list is signaled with 
+ * \ref kn_signal or \ref kn_signal_all, or until the timeout expires.
+ * 
+ * To avoid missing a signal sent by an interrupt, test the condition being 
+ * waited for and call this function with interrupts disabled (for example 
+ * within an \c ATOMIC_BLOCK).  Interrupts are enabled while the thread is 
+ * blocked, and the caller's interrupt state is restored before returning, so 
+ * the condition may be tested again in a loop.
+ * 
+ * \param[in] list The wait list to block on.
+ * \param[in] timeout The maximum time to wait, in milliseconds, or 
+ * \ref KN_WAIT_FOREVER.
+ * 
+ * \return True if the thread was signaled, or false if the wait timed out.
+ */
+extern bool kn_wait(wait_list* list, const uint16_t timeout);
+
+/**
+ * Blocks the calling thread on several wait lists at once, until any of them 
+ * is signaled or the timeout expires.  The rules are the same as for 
+ * \ref kn_wait: call it with interrupts disabled after testing each 
+ * condition, and test them again after it returns.
+ * 
+ * \code
+ * wait_list* sources[] = { kn_uart_rx_wait_list(), &commands };
+ * 
+ * ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+ * {
+ *   while (!kn_uart_available() && !command_ready())
+ *   {
+ *     if (kn_wait_any(sources, 2, 100) < 0)
+ *     {
+ *       break;
+ *     }
+ *   }
+ * }
+ * \endcode
+ * 
+ * Only the first signal wakes the thread.  A signal on another list before 
+ * the thread runs passes it by and wakes the next thread waiting on that 
+ * list, if there is one.  Since the calling thread tests every condition 
+ * again, it still sees the data behind a signal that passed it by.
+ * 
+ * \param[in] lists The wait lists to block on.
+ * \param[in] count The number of lists, at most 127.
+ * \param[in] timeout The maximum time to wait, in milliseconds, or 
+ * \ref KN_WAIT_FOREVER.
+ * 
+ * \return The index in \c lists of the list that woke the thread, or -1 if 
+ * the wait timed out.
+ */
+extern int8_t kn_wait_any(wait_list* const lists[], const uint8_t count, 
+                          const uint16_t timeout);
+
+/**
+ * Wakes the lowest numbered thread blocked on a wait list.  May be called 
+ * from an interrupt.
+ * 
+ * \param[in] list The wait list to signal.
+ * 
+ * \return True if a thread was woken.
+ */
+extern bool kn_signal(wait_list* list);
+
+/**
+ * Wakes every thread blocked on a wait list.  May be called from an interrupt.
+ * 
+ * \param[in] list The wait list to signal.
+ */
+extern void kn_signal_all(wait_list* list);
+
+/**
+ * Updates the notification word of a thread, and wakes the thread if it is 
+ * waiting in \ref kn_notify_wait.  Each thread has one 16 bit notification 
+ * word, so a single producer can signal a thread, or pass it a value, with no 
+ * semaphore or queue.  May be called from an interrupt.
+ * 
+ * \param[in] t_id The thread to notify.
+ * \param[in] action How \c value is applied to the word.
+ * \param[in] value The bits to set, or the new value of the word.  Ignored 
+ * for \ref NOTIFY_INCREMENT.
+ */
+extern void kn_notify(const thread_id t_id, const notify_action action,
+                      const uint16_t value);
+
+/**
+ * Blocks the calling thread until its notification word is not 0, then 
+ * returns the word and clears it.  Returns immediately if the word is already 
+ * set.
+ * 
+ * \param[out] value Receives the notification word.
+ * \param[in] timeout The maximum time to wait, in milliseconds, or 
+ * \ref KN_WAIT_FOREVER.
+ * 
+ * \return False if the wait timed out.
+ */
+extern bool kn_notify_wait(uint16_t* value, const uint16_t timeout);
+
+#ifdef KERNEL_USE_MESSAGES
+/**
+ * Sends a message to a thread and blocks until it replies.  If the receiver 
+ * is waiting in \ref kn_receive, the kernel switches straight to it rather 
+ * than running the scheduler.  The message is passed by pointer, so it must 
+ * remain valid until the receiver replies.
+ * 
+ * \param[in] receiver The thread to send to, which may not be the caller.
+ * \param[in] msg The message.
+ * \param[out] reply Receives the pointer passed to \ref kn_reply.  May be 
+ * \c NULL.
+ * \param[in] timeout The maximum time to wait for the reply, in milliseconds, 
+ * or \ref KN_WAIT_FOREVER.
+ * 
+ * \return False if the wait timed out.  If the message had already been 
+ * received, the receiver may still be using it.
+ */
+extern bool kn_send(const thread_id receiver, void* msg, void** reply,
+                    const uint16_t timeout);
+
+/**
+ * Blocks the calling thread until a message is sent to it.  Messages that 
+ * arrive while the thread is busy are received in order of the senders' ids.
+ * 
+ * \param[out] sender Receives the id of the sending thread, which must be 
+ * passed to \ref kn_reply.
+ * \param[out] msg Receives the message.
+ * \param[in] timeout The maximum time to wait, in milliseconds, or 
+ * \ref KN_WAIT_FOREVER.
+ * 
+ * \return False if the wait timed out.
+ */
+extern bool kn_receive(thread_id* sender, void** msg, const uint16_t timeout);
+
+/**
+ * Replies to a received message, and switches straight to the sender so that 
+ * it handles the reply without a pass through the scheduler.  The caller 
+ * stays ready, and runs again in its normal turn.  Has no effect if the 
+ * sender stopped waiting.
+ * 
+ * \param[in] sender The id given by \ref kn_receive.
+ * \param[in] reply The pointer that the sender receives.
+ */
+extern void kn_reply(const thread_id sender, void* reply);
+#endif
+
+#ifdef KERNEL_USE_IDLE_HOOK
+/**
+ * Registers a function to be called when no thread is ready to run.  Used 
+ * only if \ref KERNEL_USE_IDLE_HOOK is defined.
+ * 
+ * The hook runs with interrupts enabled on the kernel's idle stack, and 
+ * should do a small amount of work per call so that threads woken by an 
+ * interrupt are not delayed.  \ref kn_current_thread returns the last thread 
+ * that ran.
+ * 
+ * \param[in] hook The idle hook, or \c NULL to sleep whenever the kernel is 
+ * idle.
+ * 
+ * \warning The hook must not call any kernel function that blocks or yields.
+ */
+extern void kn_set_idle_hook(idle_hook_ptr hook);
+#endif
+
 /**
  * Returns the system timer, in milliseconds. This value will overflow after 
  * 49 days.
@@ -158,6 +399,11 @@ extern bool kn_thread_suspended(const thread_id t_id);
  */
 extern bool kn_thread_sleeping(const thread_id t_id);
 
+/**
+ * Returns true if the specified thread is enabled, but blocked on a wait list.
+ */
+extern bool kn_thread_blocked(const thread_id t_id);
+
 /**
  * Disables the specified thread. After a thread has been disabled, you must 
  * call \ref kn_create_thread to restart it or replace it with a new thread. If 
@@ -178,7 +424,7 @@ static inline void kn_disable_self();
 
 /**
  * Resumes the specified thread, so that the scheduler may select it for 
- * execution.
+ * execution.  This also ends a wait in \ref kn_suspend_timeout.
  */
 extern void kn_resume(const thread_id t_id);
 
@@ -196,6 +442,17 @@ extern void kn_suspend(const thread_id t_id);
  */
 static inline void kn_suspend_self();
 
+/**
+ * Suspends the calling thread until it is resumed with \ref kn_resume, or 
+ * until the timeout expires.
+ * 
+ * \param[in] timeout The maximum time to remain suspended, in milliseconds, or 
+ * \ref KN_WAIT_FOREVER.
+ * 
+ * \return True if the thread was resumed, or false if the timeout expired.
+ */
+extern bool kn_suspend_timeout(const uint16_t timeout);
+
 /**
  * @}
  */
@@ -203,4 +460,8 @@ static inline void kn_suspend_self();
 // inline function definitions
 #include "core/kernel-inl.h"
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,429 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief C++ interface for the kernel.
+ * \see kernel_cpp
+ */
+
+#ifndef KERNEL_HPP_
+#define KERNEL_HPP_
+
+#ifndef __cplusplus
+  #error "kernel.hpp may only be included from C++"
+#endif
+
+#include "kernel.h"
+#include "config.h"
+#include "kernel_atomic.h"
+
+/**
+ * \defgroup kernel_cpp C++ Interface
+ * \brief Header only C++ wrappers for the kernel.
+ * 
+ * The wrappers add type checking and compile time checks on top of the C 
+ * interface without adding any cost: every member function is an inline call 
+ * to the C function it wraps, there are no virtual functions, and nothing is 
+ * allocated from the heap.  Kernel objects have \c constexpr constructors, so 
+ * global instances are initialized like C structs rather than by code that 
+ * runs before \c main.  Requires C++11.
+ * 
+ * \code
+ * void blink(const thread_id my_id, void* arg);
+ * 
+ * // does not compile if THREAD1_STACK_SIZE is less than 48
+ * typedef kn::Thread<THREAD1, &blink, 48> BlinkThread;
+ * kn::Queue<uint16_t, 8> readings;
+ * kn::Semaphore ready;
+ * 
+ * BlinkThread::create();
+ * \endcode
+ * 
+ * @{
+ */
+
+namespace kn
+{
+
+/**
+ * Returns the size of a thread's stack, as set in \ref config.h, or 0 if the 
+ * thread does not exist.
+ */
+constexpr uint16_t stack_size(const thread_id t_id)
+{
+  return t_id == THREAD0 ? THREAD0_STACK_SIZE :
+  #if MAX_THREADS >= 2
+    t_id == THREAD1 ? THREAD1_STACK_SIZE :
+  #endif
+  #if MAX_THREADS >= 3
+    t_id == THREAD2 ? THREAD2_STACK_SIZE :
+  #endif
+  #if MAX_THREADS >= 4
+    t_id == THREAD3 ? THREAD3_STACK_SIZE :
+  #endif
+  #if MAX_THREADS >= 5
+    t_id == THREAD4 ? THREAD4_STACK_SIZE :
+  #endif
+  #if MAX_THREADS >= 6
+    t_id == THREAD5 ? THREAD5_STACK_SIZE :
+  #endif
+  #if MAX_THREADS >= 7
+    t_id == THREAD6 ? THREAD6_STACK_SIZE :
+  #endif
+  #if MAX_THREADS == 8
+    t_id == THREAD7 ? THREAD7_STACK_SIZE :
+  #endif
+    0;
+}
+
+/**
+ * A thread with a fixed id and entry point.  All members are static, since 
+ * the thread is fully described by its template arguments.
+ * 
+ * \tparam Id The id of the thread.
+ * \tparam Entry The function that the thread executes.
+ * \tparam MinStackSize The smallest stack that the thread can run on, or 0 to 
+ * skip the check.  Stacks are laid out by \ref config.h, so this does not 
+ * size the stack; compilation fails if the configured size is smaller.
+ */
+template <thread_id Id, thread_ptr Entry, uint16_t MinStackSize = 0>
+class Thread
+{
+  static_assert(Id < MAX_THREADS, "thread id is not less than MAX_THREADS");
+  static_assert(Entry != nullptr, "thread entry point is null");
+  static_assert(MinStackSize <= stack_size(Id), 
+                "configured stack size is smaller than the thread needs");
+  
+public:
+  Thread() = delete;
+  
+  /** The id of the thread. */
+  static constexpr thread_id id() { return Id; }
+  
+  /** \see kn_create_thread */
+  static void create(const bool suspended = false, void* arg = nullptr)
+  {
+    kn_create_thread(Id, Entry, suspended, arg);
+  }
+  
+  /** \see kn_resume */
+  static void resume() { kn_resume(Id); }
+  /** \see kn_suspend */
+  static void suspend() { kn_suspend(Id); }
+  /** \see kn_disable */
+  static void disable() { kn_disable(Id); }
+  /** \see kn_wake */
+  static void wake() { kn_wake(Id); }
+  /** \see kn_notify */
+  static void notify(const notify_action action, const uint16_t value = 0)
+  {
+    kn_notify(Id, action, value);
+  }
+  
+  /** \see kn_thread_enabled */
+  static bool enabled() { return kn_thread_enabled(Id); }
+  /** \see kn_thread_suspended */
+  static bool suspended() { return kn_thread_suspended(Id); }
+  /** \see kn_thread_sleeping */
+  static bool sleeping() { return kn_thread_sleeping(Id); }
+  /** \see kn_thread_blocked */
+  static bool blocked() { return kn_thread_blocked(Id); }
+};
+
+/**
+ * Functions that act on the calling thread.
+ */
+namespace this_thread
+{
+  /** \see kn_current_thread */
+  inline thread_id id() { return kn_current_thread(); }
+  /** \see kn_yield */
+  inline void yield() { kn_yield(); }
+  /** \see kn_yield_if_needed */
+  inline void yield_if_needed() { kn_yield_if_needed(); }
+  /** \see kn_sleep */
+  inline void sleep(const uint16_t millis) { kn_sleep(millis); }
+  /** \see kn_suspend_self */
+  inline void suspend() { kn_suspend_self(); }
+  /** \see kn_notify_wait */
+  inline bool notify_wait(uint16_t& value, 
+                          const uint16_t timeout = KN_WAIT_FOREVER)
+  {
+    return kn_notify_wait(&value, timeout);
+  }
+}
+
+/**
+ * A counting semaphore, with a count of at most 255.  \ref give and 
+ * \ref try_take may be called from interrupts.
+ */
+class Semaphore
+{
+public:
+  /**
+   * \param[in] initial The initial count.
+   */
+  constexpr explicit Semaphore(const uint8_t initial = 0)
+    : count_(initial), waiters_(0)
+  {
+  }
+  
+  Semaphore(const Semaphore&) = delete;
+  Semaphore& operator=(const Semaphore&) = delete;
+  
+  /**
+   * Decrements the count, blocking while it is 0.
+   * 
+   * \param[in] timeout The maximum time to wait, in milliseconds, or 
+   * \ref KN_WAIT_FOREVER.
+   * 
+   * \return False if the wait timed out.
+   */
+  bool take(const uint16_t timeout = KN_WAIT_FOREVER)
+  {
+    KN_ATOMIC_BLOCK
+    {
+      while (count_ == 0)
+      {
+        if (!kn_wait(&waiters_, timeout))
+        {
+          return false;
+        }
+      }
+      
+      count_--;
+    }
+    
+    return true;
+  }
+  
+  /**
+   * Decrements the count without blocking.
+   * 
+   * \return False if the count was 0.
+   */
+  bool try_take()
+  {
+    KN_ATOMIC_BLOCK
+    {
+      if (count_ == 0)
+      {
+        return false;
+      }
+      
+      count_--;
+    }
+    
+    return true;
+  }
+  
+  /**
+   * Increments the count, unless it is already 255, and wakes a waiting 
+   * thread.
+   */
+  void give()
+  {
+    KN_ATOMIC_BLOCK
+    {
+      if (count_ != UINT8_MAX)
+      {
+        count_++;
+      }
+      
+      kn_signal(&waiters_);
+    }
+  }
+  
+  /** Returns the current count. */
+  uint8_t count() const { return count_; }
+  
+  /** Returns the wait list signaled by \ref give, for \ref kn_wait_any. */
+  wait_list* take_wait_list() { return &waiters_; }
+  
+private:
+  volatile uint8_t count_;
+  wait_list waiters_;
+};
+
+/**
+ * A fixed size FIFO queue.  Items are copied in and out with interrupts 
+ * disabled, so \c T should be small.  The \c try_ functions may be called 
+ * from interrupts.
+ * 
+ * \tparam T The type of the items.
+ * \tparam N The capacity, a power of 2 in the range [2,128].
+ */
+template <typename T, uint8_t N>
+class Queue
+{
+  static_assert(N >= 2 && N <= 128 && (N & (N - 1)) == 0,
+                "queue capacity must be a power of 2 in the range [2,128]");
+  
+public:
+  constexpr Queue()
+    : items_(), head_(0), tail_(0), receivers_(0), senders_(0)
+  {
+  }
+  
+  Queue(const Queue&) = delete;
+  Queue& operator=(const Queue&) = delete;
+  
+  /**
+   * Adds an item to the back of the queue, blocking while it is full.
+   * 
+   * \param[in] item The item to add.
+   * \param[in] timeout The maximum time to wait, in milliseconds, or 
+   * \ref KN_WAIT_FOREVER.
+   * 
+   * \return False if the wait timed out.
+   */
+  bool send(const T& item, const uint16_t timeout = KN_WAIT_FOREVER)
+  {
+    KN_ATOMIC_BLOCK
+    {
+      while (full())
+      {
+        if (!kn_wait(&senders_, timeout))
+        {
+          return false;
+        }
+      }
+      
+      push(item);
+    }
+    
+    return true;
+  }
+  
+  /**
+   * Adds an item to the back of the queue without blocking.
+   * 
+   * \return False if the queue was full.
+   */
+  bool try_send(const T& item)
+  {
+    KN_ATOMIC_BLOCK
+    {
+      if (full())
+      {
+        return false;
+      }
+      
+      push(item);
+    }
+    
+    return true;
+  }
+  
+  /**
+   * Removes the item at the front of the queue, blocking while it is empty.
+   * 
+   * \param[out] item Receives the item.
+   * \param[in] timeout The maximum time to wait, in milliseconds, or 
+   * \ref KN_WAIT_FOREVER.
+   * 
+   * \return False if the wait timed out.
+   */
+  bool receive(T& item, const uint16_t timeout = KN_WAIT_FOREVER)
+  {
+    KN_ATOMIC_BLOCK
+    {
+      while (empty())
+      {
+        if (!kn_wait(&receivers_, timeout))
+        {
+          return false;
+        }
+      }
+      
+      pop(item);
+    }
+    
+    return true;
+  }
+  
+  /**
+   * Removes the item at the front of the queue without blocking.
+   * 
+   * \return False if the queue was empty.
+   */
+  bool try_receive(T& item)
+  {
+    KN_ATOMIC_BLOCK
+    {
+      if (empty())
+      {
+        return false;
+      }
+      
+      pop(item);
+    }
+    
+    return true;
+  }
+  
+  /** Returns the number of items in the queue. */
+  uint8_t size() const { return head_ - tail_; }
+  
+  /** Returns the capacity of the queue. */
+  static constexpr uint8_t capacity() { return N; }
+  
+  /** 
+   * Returns the wait list signaled when an item is added, for 
+   * \ref kn_wait_any.
+   */
+  wait_list* receive_wait_list() { return &receivers_; }
+  
+private:
+  // the indexes run freely, and are masked when used
+  // head - tail is the number of items in the queue
+  
+  bool full() const { return (uint8_t)(head_ - tail_) == N; }
+  bool empty() const { return head_ == tail_; }
+  
+  void push(const T& item)
+  {
+    uint8_t head = head_;
+    items_[head & (N - 1)] = item;
+    head_ = head + 1;
+    kn_signal(&receivers_);
+  }
+  
+  void pop(T& item)
+  {
+    uint8_t tail = tail_;
+    item = items_[tail & (N - 1)];
+    tail_ = tail + 1;
+    kn_signal(&senders_);
+  }
+  
+  T items_[N];
+  volatile uint8_t head_;
+  volatile uint8_t tail_;
+  wait_list receivers_;
+  wait_list senders_;
+};
+
+} // namespace kn
+
+/**
+ * @}
+ */
+
+#endif /* KERNEL_HPP_ */
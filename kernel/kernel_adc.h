@@ -0,0 +1,109 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Interface for the ADC driver.
+ * \see kernel_adc
+ */
+
+#ifndef KERNEL_ADC_H_
+#define KERNEL_ADC_H_
+
+#include "kernel_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \defgroup kernel_adc ADC Driver
+ * \brief Timer triggered sampling of a list of ADC channels, delivered to a 
+ * thread in blocks.
+ * 
+ * Timer1 triggers each conversion at a fixed rate, and the conversion complete 
+ * interrupt stores the result and moves to the next channel in the list, so 
+ * sampling needs no help from a thread.  Samples are collected in two buffers 
+ * of \ref ADC_BLOCK_SIZE samples.  When one buffer is full the interrupt 
+ * switches to the other one and wakes the thread waiting in 
+ * \ref kn_adc_wait_block, which then has until the second buffer fills to 
+ * process the first.  If it falls behind, the interrupt reuses the buffer it 
+ * just filled, and the block is counted in \ref kn_adc_overruns.
+ * 
+ * Within a block, samples are stored in the order of the channel list, one 
+ * scan after another.  A block always holds whole scans, so if the number of 
+ * channels does not divide \ref ADC_BLOCK_SIZE the remaining samples are 
+ * unused.
+ * 
+ * Timer1 is used by the driver while sampling, so it may not be used with 
+ * \ref CRITICAL_STATS_TIMER1 or the \ref kernel_hrtimer at the same time.
+ * 
+ * @{
+ */
+
+/**
+ * Starts sampling.  Any sampling already in progress is stopped, and blocks 
+ * that were not collected are dropped.
+ * 
+ * \param[in] channels The channels to sample, which are the values of the MUX 
+ * bits (including \c MUX5 on parts that have it).  The list is used in place, 
+ * so it must remain valid until sampling is stopped.
+ * \param[in] count The number of channels, at least 1 and at most 
+ * \ref ADC_BLOCK_SIZE.
+ * \param[in] reference The value of the \c REFS bits in \c ADMUX, such as 
+ * <tt>_BV(REFS0)</tt> to use AVcc.
+ * \param[in] sample_rate The number of conversions per second, across all 
+ * channels.
+ */
+extern void kn_adc_start(const uint8_t* channels, const uint8_t count,
+                         const uint8_t reference, const uint16_t sample_rate);
+
+/**
+ * Stops sampling, and wakes a thread waiting for a block.
+ */
+extern void kn_adc_stop();
+
+/**
+ * Blocks until a full buffer of samples is ready.  The buffer belongs to the 
+ * caller until the next call to this function, so only one thread may 
+ * collect blocks.
+ * 
+ * \param[out] len Receives the number of samples in the block.
+ * \param[in] timeout The maximum time to wait, in milliseconds, or 
+ * \ref KN_WAIT_FOREVER.
+ * 
+ * \return The samples, or \c NULL if the wait timed out or sampling was 
+ * stopped.
+ */
+extern const uint16_t* kn_adc_wait_block(uint8_t* len, const uint16_t timeout);
+
+/**
+ * Returns the number of blocks that were dropped because the previous block 
+ * had not been collected in time, and resets the count.
+ */
+extern uint8_t kn_adc_overruns();
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KERNEL_ADC_H_ */
@@ -0,0 +1,102 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Interface for the kernel's interrupts-disabled sections.
+ * \see kernel_atomic
+ */
+
+#ifndef KERNEL_ATOMIC_H_
+#define KERNEL_ATOMIC_H_
+
+#include "kernel_types.h"
+#include "config.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \defgroup kernel_atomic Atomic Blocks
+ * \brief Interrupts-disabled sections that the kernel can measure.
+ * 
+ * \ref KN_ATOMIC_BLOCK is used in place of 
+ * <tt>ATOMIC_BLOCK(ATOMIC_RESTORESTATE)</tt> from avr-libc.  It is the same 
+ * macro unless \ref KERNEL_USE_CRITICAL_STATS is defined, in which case the 
+ * time that interrupts are disabled is added to the statistics returned by 
+ * \ref kn_critical_stats.  The kernel, its drivers and the C++ wrappers use 
+ * it for all of their own sections, and application code may use it to have 
+ * its sections measured as well.
+ * 
+ * \code
+ * KN_ATOMIC_BLOCK
+ * {
+ *   position = new_position;
+ * }
+ * \endcode
+ * 
+ * @{
+ */
+
+/**
+ * Disables interrupts, and starts timing a critical section if interrupts 
+ * were enabled.
+ * 
+ * \return The previous value of \c SREG, to pass to \ref kn_critical_end.
+ */
+static inline uint8_t kn_critical_begin();
+
+/**
+ * Restores the interrupt state saved by \ref kn_critical_begin, and records 
+ * the critical section if this enables interrupts again.
+ * 
+ * \param[in] sreg The value returned by \ref kn_critical_begin.
+ */
+static inline void kn_critical_end(const uint8_t* sreg);
+
+/** \def KN_ATOMIC_BLOCK
+ * Runs the block that follows with interrupts disabled, and restores the 
+ * previous interrupt state when the block is left.  Follows the same pattern 
+ * as the avr-libc macro, so \c return and \c break may be used inside it.
+ */
+#ifdef KERNEL_USE_CRITICAL_STATS
+  #define KN_ATOMIC_BLOCK \
+    for (uint8_t kn_sreg_save \
+           __attribute__((__cleanup__(kn_critical_end))) = \
+           kn_critical_begin(), kn_todo = 1; \
+         kn_todo; kn_todo = 0)
+#else
+  #define KN_ATOMIC_BLOCK ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#endif
+
+/**
+ * @}
+ */
+
+// inline function definitions
+#include "core/critical-inl.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KERNEL_ATOMIC_H_ */
@@ -0,0 +1,193 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Interface for the SPI and TWI (I2C) bus drivers.
+ * \see kernel_bus
+ */
+
+#ifndef KERNEL_BUS_H_
+#define KERNEL_BUS_H_
+
+#include "kernel_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \defgroup kernel_bus Bus Drivers
+ * \brief Queued, interrupt driven transfers on the SPI and TWI (I2C) buses.
+ * 
+ * A thread describes a transfer with a \ref bus_transfer and submits it to a 
+ * bus.  Submitted transfers are queued in order, and each bus interrupt runs 
+ * its transfer as a state machine, starting the next queued transfer as soon 
+ * as one completes.  The submitting thread blocks until its transfer 
+ * completes, so any number of threads may share a bus without polling.
+ * 
+ * Every transfer writes \c tx_len bytes from \c tx, and then reads \c rx_len 
+ * bytes into \c rx, which covers the common "write a register address, read 
+ * its value" pattern.  On the TWI bus the read follows a repeated start.  On 
+ * the SPI bus \c 0xFF is clocked out while reading, and the bytes received 
+ * while writing are discarded.
+ * 
+ * A transfer that has been submitted belongs to the driver until it 
+ * completes or its wait times out, and must not be modified or go out of 
+ * scope before then.  A transfer whose wait times out is cancelled: it is 
+ * removed from the queue, or if it is in progress it is stopped after the 
+ * current byte.
+ * 
+ * @{
+ */
+
+/** The state of a \ref bus_transfer. */
+typedef enum
+{
+  /** The transfer is queued or in progress. */
+  BUS_PENDING = 0,
+  /** The transfer completed successfully. */
+  BUS_DONE,
+  /** The device did not acknowledge, or arbitration was lost (TWI only). */
+  BUS_ERROR,
+  /** The transfer was cancelled because its wait timed out. */
+  BUS_CANCELLED
+} bus_status;
+
+/** Describes a transfer on the SPI or TWI bus. */
+typedef struct bus_transfer
+{
+  /** For SPI, the port register of the device's chip select pin. */
+  volatile uint8_t* cs_port;
+  /** 
+   * For SPI, the mask of the device's chip select pin in \c cs_port, which 
+   * is driven low for the transfer.  For TWI, the 7 bit address of the 
+   * device.
+   */
+  uint8_t address;
+  /** The bytes to write. */
+  const uint8_t* tx;
+  /** The number of bytes to write. */
+  uint8_t tx_len;
+  /** Receives the bytes read. */
+  uint8_t* rx;
+  /** The number of bytes to read. */
+  uint8_t rx_len;
+  
+  /** \cond */
+  // driver state
+  struct bus_transfer* next;
+  volatile bus_status status;
+  wait_list waiter;
+  /** \endcond */
+} bus_transfer;
+
+/**
+ * Sets up the SPI hardware as a bus master.  The \c SS pin is made an output, 
+ * and must not be used as an input while the bus is in use.
+ * 
+ * \param[in] control The clock settings for \c SPCR: any of the \c CPOL, 
+ * \c CPHA, \c DORD, \c SPR1 and \c SPR0 bits.
+ * \param[in] double_speed If true, \c SPI2X is set to double the SPI clock.
+ */
+extern void kn_spi_init(const uint8_t control, const bool double_speed);
+
+/**
+ * Queues a transfer on the SPI bus and returns without waiting for it.  
+ * \ref kn_spi_wait must be used to wait for the transfer to complete.  May be 
+ * called from an interrupt.
+ * 
+ * \param[in] transfer The transfer to run.
+ */
+extern void kn_spi_submit(bus_transfer* transfer);
+
+/**
+ * Blocks until a submitted SPI transfer completes, or cancels it if the 
+ * timeout expires.
+ * 
+ * \param[in] transfer The transfer to wait for.
+ * \param[in] timeout The maximum time to wait, in milliseconds, or 
+ * \ref KN_WAIT_FOREVER.
+ * 
+ * \return The final state of the transfer.
+ */
+extern bus_status kn_spi_wait(bus_transfer* transfer, const uint16_t timeout);
+
+/**
+ * Runs a transfer on the SPI bus, blocking until it completes.  Equivalent 
+ * to \ref kn_spi_submit followed by \ref kn_spi_wait.
+ * 
+ * \param[in] transfer The transfer to run.
+ * \param[in] timeout The maximum time to wait, in milliseconds, or 
+ * \ref KN_WAIT_FOREVER.
+ * 
+ * \return The final state of the transfer.
+ */
+extern bus_status kn_spi_transfer(bus_transfer* transfer, 
+                                  const uint16_t timeout);
+
+/**
+ * Sets up the TWI hardware as a bus master.
+ * 
+ * \param[in] frequency The SCL frequency in Hz, for example 100000 or 400000.
+ */
+extern void kn_twi_init(const uint32_t frequency);
+
+/**
+ * Queues a transfer on the TWI bus and returns without waiting for it.  
+ * \ref kn_twi_wait must be used to wait for the transfer to complete.  May be 
+ * called from an interrupt.
+ * 
+ * \param[in] transfer The transfer to run.
+ */
+extern void kn_twi_submit(bus_transfer* transfer);
+
+/**
+ * Blocks until a submitted TWI transfer completes, or cancels it if the 
+ * timeout expires.
+ * 
+ * \param[in] transfer The transfer to wait for.
+ * \param[in] timeout The maximum time to wait, in milliseconds, or 
+ * \ref KN_WAIT_FOREVER.
+ * 
+ * \return The final state of the transfer.
+ */
+extern bus_status kn_twi_wait(bus_transfer* transfer, const uint16_t timeout);
+
+/**
+ * Runs a transfer on the TWI bus, blocking until it completes.  Equivalent 
+ * to \ref kn_twi_submit followed by \ref kn_twi_wait.
+ * 
+ * \param[in] transfer The transfer to run.
+ * \param[in] timeout The maximum time to wait, in milliseconds, or 
+ * \ref KN_WAIT_FOREVER.
+ * 
+ * \return The final state of the transfer.
+ */
+extern bus_status kn_twi_transfer(bus_transfer* transfer, 
+                                  const uint16_t timeout);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
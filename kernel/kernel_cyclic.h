@@ -0,0 +1,127 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Interface for the cyclic executive.
+ * \see kernel_cyclic
+ */
+
+#ifndef KERNEL_CYCLIC_H_
+#define KERNEL_CYCLIC_H_
+
+#include "kernel_types.h"
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef KERNEL_USE_CYCLIC
+
+/**
+ * \defgroup kernel_cyclic Cyclic Executive
+ * \brief Time triggered tasks run from a static schedule.
+ * 
+ * The cyclic executive runs tasks from a schedule table in program memory.  
+ * The table divides a major frame into slots of equal length, and names the 
+ * task that runs at the start of each slot, or \c NULL for an empty slot.  
+ * After the last slot the table repeats:
+ * 
+ * \code
+ * const cyclic_task schedule[] PROGMEM = {
+ *   &read_sensors, &control, &read_sensors, &log_state
+ * };
+ * 
+ * // 4 slots of 5 ms, so a 20 ms major frame
+ * kn_cyclic_start(schedule, 4, 5);
+ * \endcode
+ * 
+ * Tasks are dispatched directly from the kernel's timer interrupt, so their 
+ * start times do not depend on when threads yield.  The only jitter is the 
+ * latency of any section that has interrupts disabled when the tick arrives.  
+ * A task runs with interrupts enabled, ahead of every thread, and must return 
+ * before the end of its slot.  If a task is still running at the start of the 
+ * next slot, that slot counts as an overrun and its task is skipped (see 
+ * \ref kn_cyclic_overruns).
+ * 
+ * Because they run in interrupt context, tasks may only use the kernel 
+ * functions that are safe to call from an interrupt, such as 
+ * \ref kn_signal, \ref kn_resume and \ref kn_notify.  This lets a task hand 
+ * longer work off to a thread.  Tasks also run on the stack of whichever 
+ * thread was interrupted, so every thread's stack must have room for the 
+ * deepest task.
+ * 
+ * With \ref KERNEL_USE_IDLE_HOOK, a slot that starts while the idle hook is 
+ * running is deferred, since the idle stack has no room for a task.  The 
+ * scheduler runs the task on the stack of the last thread to run once the 
+ * hook returns, or the tick wakes the processor from sleep.  If that thread 
+ * was disabled, or returned from its entry point, its stack is no longer its 
+ * own, and the task waits until a thread yields with nothing else ready; a 
+ * task that is still waiting when its next slot starts counts as an overrun.
+ * 
+ * Threads keep running round robin in the time that tasks leave free.
+ * 
+ * @{
+ */
+
+/**
+ * A task run by the cyclic executive.
+ */
+typedef void (*cyclic_task)();
+
+/**
+ * Starts running a schedule, beginning with the first slot at the next tick.  
+ * Replaces any schedule that is already running.
+ * 
+ * \param[in] table The schedule table, which must be in program memory below 
+ * 64 KB, as \c PROGMEM data normally is.  It is used until the executive is 
+ * stopped.
+ * \param[in] slots The number of slots in the table.  Must be at least 1.
+ * \param[in] slot_length The length of each slot in milliseconds.  Must be 
+ * at least 1.
+ */
+extern void kn_cyclic_start(const cyclic_task* table, const uint8_t slots,
+                            const uint8_t slot_length);
+
+/**
+ * Stops running the schedule.  A task that is running is allowed to finish.
+ */
+extern void kn_cyclic_stop();
+
+/**
+ * Returns the number of slots that have been skipped because the task of the 
+ * previous slot overran, since the executive was started.  The count stops 
+ * at \c UINT16_MAX.
+ * 
+ * \param[out] slot If not \c NULL, receives the slot of the task that most 
+ * recently overran.
+ */
+extern uint16_t kn_cyclic_overruns(uint8_t* slot);
+
+/**
+ * @}
+ */
+
+#endif /* KERNEL_USE_CYCLIC */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KERNEL_CYCLIC_H_ */
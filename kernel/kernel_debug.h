@@ -27,15 +27,21 @@
 #include "kernel_types.h"
 #include "config.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
  * \addtogroup kernel_interface
  * @{
  */
 
-#ifdef KERNEL_USE_STACK_CANARY
+#if defined(KERNEL_USE_STACK_CANARY) || defined(KERNEL_USE_STACK_CHECK)
 /**
  * A user supplied function that is called when a stack overflow is detected. 
- * Used only if \ref KERNEL_USE_STACK_CANARY is defined.
+ * Used only if \ref KERNEL_USE_STACK_CANARY or \ref KERNEL_USE_STACK_CHECK is 
+ * defined.  With \ref KERNEL_USE_STACK_CHECK it may be called from the timer 
+ * interrupt.
  * 
  * \param[in] t_id The id of the active thread when the stack overflow was 
  * detected. This does not necessarily mean that corruption is limited to this 
@@ -47,6 +53,32 @@
 extern void kn_stack_overflow(const thread_id t_id);
 #endif
 
+#ifdef KERNEL_USE_HOG_DETECT
+/**
+ * Returns the longest time, in milliseconds, that a thread has run without 
+ * giving up the processor since it was created.  Used only if 
+ * \ref KERNEL_USE_HOG_DETECT is defined.
+ * 
+ * Time is counted from the moment the scheduler switches to the thread (or 
+ * back to it after a yield) until the thread next enters the scheduler.  
+ * Interrupts that occur in between are included.
+ */
+extern uint16_t kn_thread_max_run(const thread_id t_id);
+
+#ifdef HOG_BUDGET
+/**
+ * A user supplied function that is called from the timer interrupt when the 
+ * running thread has gone more than \ref HOG_BUDGET milliseconds without 
+ * giving up the processor.  It is called once each time the budget is 
+ * exceeded.  Used only if \ref KERNEL_USE_HOG_DETECT and \ref HOG_BUDGET are 
+ * defined.
+ * 
+ * \param[in] t_id The running thread.
+ */
+extern void kn_thread_hog(const thread_id t_id);
+#endif
+#endif
+
 #ifdef KERNEL_USE_ASSERT
 /**
  * If the given expression evaluates to false, calls \ref kn_assertion_failure.
@@ -76,8 +108,47 @@ extern void kn_assertion_failure(const char* expr, const char* file,
   #define kn_assert(expr) ((void)0)
 #endif
 
+#ifdef KERNEL_USE_CRITICAL_STATS
+/**
+ * Statistics for the sections of code in which the kernel disables 
+ * interrupts.  Durations are measured in timer counts: CPU cycles if 
+ * \ref CRITICAL_STATS_TIMER1 is defined, otherwise counts of Timer0 (64 
+ * cycles each).  Used only if \ref KERNEL_USE_CRITICAL_STATS is defined.
+ */
+typedef struct
+{
+  /** The longest section measured. */
+  uint16_t max;
+  /** 
+   * Bucket \c n counts the sections lasting from <tt>2^n</tt> up to 
+   * <tt>2^(n+1)</tt> timer counts.  The first bucket also counts sections 
+   * shorter than 1 count, and the last counts every longer section.  Counts 
+   * saturate at \c UINT16_MAX.
+   */
+  uint16_t histogram[CRITICAL_STATS_BUCKETS];
+} critical_stats;
+
+/**
+ * Copies the statistics for the kernel's interrupts-disabled sections.  Used 
+ * only if \ref KERNEL_USE_CRITICAL_STATS is defined.
+ * 
+ * \param[out] stats Receives the statistics.
+ */
+extern void kn_critical_stats(critical_stats* stats);
+
+/**
+ * Clears the statistics for the kernel's interrupts-disabled sections.  Used 
+ * only if \ref KERNEL_USE_CRITICAL_STATS is defined.
+ */
+extern void kn_critical_stats_reset();
+#endif
+
 /**
  * @}
  */
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
\ No newline at end of file
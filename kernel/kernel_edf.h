@@ -0,0 +1,129 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Interface for earliest deadline first scheduling.
+ * \see kernel_edf
+ */
+
+#ifndef KERNEL_EDF_H_
+#define KERNEL_EDF_H_
+
+#include "kernel_types.h"
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef KERNEL_USE_EDF
+
+/**
+ * \defgroup kernel_edf Deadline Scheduling
+ * \brief Earliest deadline first scheduling of periodic threads.
+ * 
+ * A periodic thread runs one job per period, which must be finished within a 
+ * relative deadline of its release, and calls \ref kn_wait_next_period at the 
+ * end of each job:
+ * 
+ * \code
+ * void control_loop(const thread_id my_id, void* arg)
+ * {
+ *   while (1)
+ *   {
+ *     // read inputs, update outputs
+ *     kn_wait_next_period();
+ *   }
+ * }
+ * 
+ * // 10 ms period, 8 ms deadline, at most 2 ms of work per job
+ * kn_create_periodic_thread(THREAD1, &control_loop, false, NULL, 10, 8, 2);
+ * \endcode
+ * 
+ * Whenever periodic threads are ready, the scheduler runs the one with the 
+ * earliest absolute deadline, with ties going to the lowest id.  Threads that 
+ * were created with \ref kn_create_thread are scheduled round robin as 
+ * usual, but only while no periodic thread is ready.  Scheduling is still 
+ * cooperative: a thread with an earlier deadline that becomes ready only 
+ * runs at the next yield.
+ * 
+ * A job that finishes after its deadline counts as a deadline miss (see 
+ * \ref kn_deadline_misses).  The next release is still computed from the 
+ * previous one rather than from the late finish, so a thread that overruns 
+ * catches up instead of drifting.
+ * 
+ * Times are in milliseconds, and a period may be at most 32767 ms.
+ * 
+ * @{
+ */
+
+/**
+ * Creates a periodic thread, if the periodic threads would still be 
+ * schedulable with it.  The test requires that the sum of 
+ * <tt>wcet / deadline</tt> over all enabled periodic threads is at most 1, 
+ * which guarantees that earliest deadline first meets every deadline when 
+ * the worst case execution times hold and the threads yield promptly.  The 
+ * first job is released immediately.
+ * 
+ * Other than the test, behaves the same as \ref kn_create_thread, including 
+ * not returning if \c t_id is the calling thread.
+ * 
+ * \param[in] t_id The id of the thread.
+ * \param[in] entry_point The function that the thread executes.
+ * \param[in] suspended If true, the thread begins execution suspended.
+ * \param[in] arg An argument passed to the thread function.
+ * \param[in] period The time between job releases.
+ * \param[in] deadline The time after each release by which the job must 
+ * finish.  Must be no more than \c period.
+ * \param[in] wcet The worst case execution time of a job.  Must be no more 
+ * than \c deadline.
+ * 
+ * \return False if the thread was not created because the test failed.
+ */
+extern bool kn_create_periodic_thread(const thread_id t_id, 
+                                      thread_ptr entry_point, 
+                                      const bool suspended, void* arg,
+                                      const uint16_t period, 
+                                      const uint16_t deadline,
+                                      const uint16_t wcet);
+
+/**
+ * Ends the calling thread's current job, and sleeps until the next release.  
+ * Counts a deadline miss if the job finished late.  Must be called only by 
+ * periodic threads.
+ */
+extern void kn_wait_next_period();
+
+/**
+ * Returns the number of deadlines a periodic thread has missed since it was 
+ * created.  The count stops at \c UINT16_MAX.
+ */
+extern uint16_t kn_deadline_misses(const thread_id t_id);
+
+/**
+ * @}
+ */
+
+#endif /* KERNEL_USE_EDF */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KERNEL_EDF_H_ */
@@ -0,0 +1,122 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Interface for the EEPROM driver.
+ * \see kernel_eeprom
+ */
+
+#ifndef KERNEL_EEPROM_H_
+#define KERNEL_EEPROM_H_
+
+#include "kernel_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \defgroup kernel_eeprom EEPROM Driver
+ * \brief Write-behind EEPROM access.
+ * 
+ * Writing a byte of EEPROM takes about 3.3 ms.  Instead of waiting for each 
+ * write, this driver stores written bytes in a cache of 
+ * \ref EEPROM_CACHE_SIZE bytes and returns immediately.  The EEPROM ready 
+ * interrupt then writes the cached bytes in the background, skipping any that 
+ * already hold the new value.  A thread only blocks when the cache is full.  
+ * Writing an address that is still in the cache replaces the cached value, so 
+ * a value that changes often costs one EEPROM write per trip through the 
+ * cache rather than one per change.
+ * 
+ * Reads return cached values, so they always see the latest write.  Reading 
+ * a byte that is not cached waits for the write in progress, if there is one.
+ * 
+ * Use \ref kn_eeprom_flush to wait for all bytes to be written, for example 
+ * before power is removed.  The driver owns the EEPROM hardware, so the 
+ * avr-libc eeprom functions must not be used alongside it.  None of these 
+ * functions may be called from an interrupt.
+ * 
+ * @{
+ */
+
+/**
+ * Reads a byte.
+ * 
+ * \param[in] address The EEPROM address.
+ */
+extern uint8_t kn_eeprom_read_byte(const uint16_t address);
+
+/**
+ * Reads a block of bytes.
+ * 
+ * \param[in] address The EEPROM address of the first byte.
+ * \param[out] buffer Receives the bytes read.
+ * \param[in] len The number of bytes to read.
+ */
+extern void kn_eeprom_read(const uint16_t address, void* buffer, 
+                           const uint16_t len);
+
+/**
+ * Writes a byte to the cache, blocking only if the cache is full.
+ * 
+ * \param[in] address The EEPROM address.
+ * \param[in] value The value to write.
+ * \param[in] timeout The maximum time to wait for space in the cache, in 
+ * milliseconds, or \ref KN_WAIT_FOREVER.
+ * 
+ * \return False if the wait timed out.
+ */
+extern bool kn_eeprom_write_byte(const uint16_t address, const uint8_t value,
+                                 const uint16_t timeout);
+
+/**
+ * Writes a block of bytes to the cache, blocking only while the cache is 
+ * full.
+ * 
+ * \param[in] address The EEPROM address of the first byte.
+ * \param[in] buffer The bytes to write.
+ * \param[in] len The number of bytes to write.
+ * \param[in] timeout The maximum time to wait for space for each byte, in 
+ * milliseconds, or \ref KN_WAIT_FOREVER.
+ * 
+ * \return The number of bytes written, which is less than \c len if a wait 
+ * timed out.
+ */
+extern uint16_t kn_eeprom_write(const uint16_t address, const void* buffer,
+                                const uint16_t len, const uint16_t timeout);
+
+/**
+ * Blocks until every cached byte has been written to the EEPROM.
+ * 
+ * \param[in] timeout The maximum time to wait, in milliseconds, or 
+ * \ref KN_WAIT_FOREVER.
+ * 
+ * \return False if the wait timed out.
+ */
+extern bool kn_eeprom_flush(const uint16_t timeout);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KERNEL_EEPROM_H_ */
@@ -0,0 +1,146 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Interface for the high resolution timer driver.
+ * \see kernel_hrtimer
+ */
+
+#ifndef KERNEL_HRTIMER_H_
+#define KERNEL_HRTIMER_H_
+
+#include "kernel_types.h"
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \defgroup kernel_hrtimer High Resolution Timer
+ * \brief Microsecond one-shot timers on Timer1.
+ * 
+ * Timer1 runs freely, and any number of one-shot timers share its compare 
+ * channel A: pending timers are kept in a list sorted by expiry, and the 
+ * compare register is always set for the first one.  When a timer expires its 
+ * callback runs in the compare interrupt, so it must be short and may only 
+ * use kernel functions that are safe in an interrupt, such as 
+ * \ref kn_signal.  \ref kn_sleep_us is built on this to block a thread for a 
+ * short time without busy waiting.
+ * 
+ * The timer counts every \ref HRTIMER_TICKS_PER_US of a microsecond, and a 
+ * timer may be at most \ref HRTIMER_MAX_US long; use \ref kn_sleep for longer 
+ * waits.  If \ref CRITICAL_STATS_TIMER1 is defined the driver shares Timer1 
+ * with the critical section statistics, which run it from the CPU clock, so 
+ * the resolution is finer but the longest timer is shorter.  Timer1 can't be 
+ * used by the \ref kernel_adc while timers are in use.
+ * 
+ * Callbacks are accurate to a few microseconds, plus the latency of any 
+ * section that has interrupts disabled.  A thread woken by a timer still 
+ * only runs at its next turn in the scheduler.
+ * 
+ * @{
+ */
+
+/** \def HRTIMER_TICKS_PER_US
+ * The number of Timer1 counts in a microsecond.
+ */
+#ifdef CRITICAL_STATS_TIMER1
+  #define HRTIMER_TICKS_PER_US (F_CPU / 1000000UL)
+#else
+  #define HRTIMER_TICKS_PER_US (F_CPU / 8000000UL)
+#endif
+
+/**
+ * The longest time a timer may be set for, in microseconds.  Pending timers 
+ * are compared with wrapping arithmetic, so they must all expire within half 
+ * of the 16 bit period of Timer1.
+ */
+#define HRTIMER_MAX_US (INT16_MAX / HRTIMER_TICKS_PER_US)
+
+/**
+ * The function run when a timer expires.
+ * 
+ * \param[in] arg The argument given to \ref kn_hrtimer_start.
+ */
+typedef void (*hrtimer_callback)(void* arg);
+
+/**
+ * A one-shot timer.  The fields are private to the driver, and the timer 
+ * must stay valid while it is pending.
+ */
+typedef struct hrtimer
+{
+  /** The next pending timer. */
+  struct hrtimer* next;
+  /** The value of \c TCNT1 at which the timer expires. */
+  uint16_t expiry;
+  /** The function run when the timer expires. */
+  hrtimer_callback callback;
+  /** The argument for the callback. */
+  void* arg;
+  /** True while the timer is pending. */
+  volatile bool pending;
+} hrtimer;
+
+/**
+ * Starts Timer1 for the driver.  Must be called before any other function of 
+ * the driver.
+ */
+extern void kn_hrtimer_init();
+
+/**
+ * Starts a timer.  If it expires before this function returns, the callback 
+ * is run before returning.  May be called from an interrupt.
+ * 
+ * \param[in] timer The timer, which must not be pending.
+ * \param[in] micros The time until it expires, in microseconds.  At most 
+ * \ref HRTIMER_MAX_US.
+ * \param[in] callback The function run when the timer expires.
+ * \param[in] arg The argument for the callback.
+ */
+extern void kn_hrtimer_start(hrtimer* timer, const uint16_t micros, 
+                             hrtimer_callback callback, void* arg);
+
+/**
+ * Stops a timer before it expires.  May be called from an interrupt.
+ * 
+ * \param[in] timer The timer.
+ * 
+ * \return True if the timer was pending, and its callback will not run.
+ */
+extern bool kn_hrtimer_cancel(hrtimer* timer);
+
+/**
+ * Blocks the calling thread for at least a number of microseconds, letting 
+ * other threads run in the meantime.
+ * 
+ * \param[in] micros The time to sleep.  At most \ref HRTIMER_MAX_US.
+ */
+extern void kn_sleep_us(const uint16_t micros);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KERNEL_HRTIMER_H_ */
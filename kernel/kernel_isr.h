@@ -0,0 +1,121 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Interface for nested interrupts.
+ * \see kernel_isr
+ */
+
+#ifndef KERNEL_ISR_H_
+#define KERNEL_ISR_H_
+
+#include "kernel_types.h"
+#include "config.h"
+#include <avr/interrupt.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef KERNEL_USE_NESTED_ISR
+
+/**
+ * \defgroup kernel_isr Nested Interrupts
+ * \brief Interrupt handlers that other interrupts may preempt.
+ * 
+ * AVR interrupts do not nest, so a long handler delays every other interrupt 
+ * until it returns.  A handler defined with \ref KN_NESTABLE_ISR may call 
+ * \ref kn_isr_nest once it has acknowledged its hardware, which enables 
+ * interrupts for the rest of the handler.  A latency critical interrupt can 
+ * then run in the middle of it:
+ * 
+ * \code
+ * KN_NESTABLE_ISR(USART_RX_vect)
+ * {
+ *   uint8_t byte = UDR0;
+ *   // the flag is cleared by reading UDR0, so the handler can't reenter
+ *   kn_isr_nest();
+ *   parse(byte);
+ * }
+ * \endcode
+ * 
+ * Before calling \ref kn_isr_nest, a handler must make sure that it can't be 
+ * entered again, usually by clearing its interrupt flag or disabling its own 
+ * interrupt.  Ordinary \c ISR handlers are unchanged, and run with interrupts 
+ * disabled as usual.
+ * 
+ * The kernel counts how deeply nestable handlers are nested.  The cyclic 
+ * executive (\ref kernel_cyclic) waits for the outermost nestable handler to 
+ * return before it starts a task, so that a task never runs ahead of a 
+ * handler it interrupted.  With \ref KERNEL_USE_ASSERT, calling a blocking 
+ * kernel function from a nestable handler fails an assertion.
+ * 
+ * Nested handlers all use the stack of the interrupted thread, so each 
+ * thread's stack must have room for every nestable handler at once, plus the 
+ * deepest other handler.  tools/stack_depth.py adds up the frames of all 
+ * handlers that enable interrupts when it sizes thread stacks.
+ * 
+ * @{
+ */
+
+/**
+ * Defines a nestable interrupt handler, in the same way as \c ISR.  The 
+ * handler may use \c return to exit early.
+ * 
+ * \param[in] vector The interrupt vector.
+ */
+#define KN_NESTABLE_ISR(vector) \
+  static inline void vector##_nestable(); \
+  ISR(vector) \
+  { \
+    kn_isr_enter(); \
+    vector##_nestable(); \
+    kn_isr_exit(); \
+  } \
+  static inline void vector##_nestable()
+
+/**
+ * Enables interrupts in a nestable handler.  Must only be called from a 
+ * handler defined with \ref KN_NESTABLE_ISR.
+ */
+static inline void kn_isr_nest();
+
+/**
+ * Returns the number of nestable handlers that are running.
+ */
+static inline uint8_t kn_isr_depth();
+
+/** \cond */
+static inline void kn_isr_enter();
+static inline void kn_isr_exit();
+/** \endcond */
+
+/**
+ * @}
+ */
+
+#include "core/isr-inl.h"
+
+#endif /* KERNEL_USE_NESTED_ISR */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KERNEL_ISR_H_ */
@@ -0,0 +1,171 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Interface for the deferred logger.
+ * \see kernel_log
+ */
+
+#ifndef KERNEL_LOG_H_
+#define KERNEL_LOG_H_
+
+#include "kernel_types.h"
+#include <avr/pgmspace.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \defgroup kernel_log Deferred Logging
+ * \brief Binary logging that is formatted on the host.
+ * 
+ * \ref KN_LOG takes a \c printf style format and up to 4 arguments, but does 
+ * no formatting.  The format string is placed in program memory, and only its 
+ * address is logged, along with the time from \ref kn_millis, the id of the 
+ * calling thread and the raw bytes of the arguments.  A message with two 
+ * \c int arguments takes about 70 cycles by a count of the instructions, 
+ * rather than the thousands that \c printf takes.
+ * 
+ * Messages are held in a ring buffer of \ref LOG_BUFFER_SIZE bytes.  A thread 
+ * running \ref kn_log_thread sends them over the \ref kernel_uart, and 
+ * tools/log_decode.py formats them on the host with the strings from the 
+ * program's ELF file:
+ * 
+ * \code
+ * kn_uart_init(115200);
+ * kn_create_thread(THREAD7, &kn_log_thread, false, NULL);
+ * 
+ * KN_LOG("adc %u, state %d", reading, state);
+ * \endcode
+ * 
+ * Arguments are stored after the default argument promotions, so the format 
+ * must match them as it would for \c printf: \c \%d, \c \%u, \c \%x and 
+ * \c \%c for values up to \c int in size, \c \%l variants for \c long, and 
+ * \c \%f for \c float and \c double.  Since only a pointer would be logged, 
+ * \c \%s prints the address rather than the string.
+ * 
+ * If the buffer is full the message is dropped, and the number of dropped 
+ * messages is reported in the stream.  \ref KN_LOG never blocks, and may be 
+ * used in interrupts, where the id logged is that of the interrupted thread.
+ * 
+ * Each message is sent as a sync byte (0xA5), the length of the arguments, 
+ * the format address, the time, the thread id and the arguments, with 
+ * multibyte values little endian.  A format address of 0 reports dropped 
+ * messages, with the count as a 16 bit argument.
+ * 
+ * Only the low 16 bits of the time are buffered, and \ref kn_log_thread 
+ * restores the rest when it sends the message, so a message that waits in 
+ * the buffer for more than 65 seconds is sent with the wrong time.
+ * 
+ * @{
+ */
+
+/**
+ * The number of bytes that each message takes in the buffer, in addition to 
+ * its arguments.
+ */
+#define LOG_HEADER_SIZE 6
+
+/**
+ * Logs a message.  See \ref kernel_log.
+ * 
+ * \param[in] ... A string literal with the format of the message, followed 
+ * by up to 4 arguments.
+ */
+#define KN_LOG(...) KN_LOG_SELECT(KN_LOG_COUNT(__VA_ARGS__))(__VA_ARGS__)
+
+/** \cond */
+// counts the arguments after the format
+#define KN_LOG_COUNT(...) KN_LOG_COUNT_(__VA_ARGS__, 4, 3, 2, 1, 0, 0)
+#define KN_LOG_COUNT_(fmt, _1, _2, _3, _4, n, ...) n
+#define KN_LOG_SELECT(n) KN_LOG_SELECT_(n)
+#define KN_LOG_SELECT_(n) KN_LOG_##n
+
+// adding 0 applies the integer promotions, as passing to printf would
+#define KN_LOG_ARG(x) __typeof__((x) + 0)
+
+#define KN_LOG_BEGIN(fmt) \
+  do \
+  { \
+    static const char kn_log_fmt[] PROGMEM = fmt;
+#define KN_LOG_END \
+    kn_log_write(kn_log_fmt, &kn_log_args, sizeof(kn_log_args)); \
+  } while (0)
+
+#define KN_LOG_0(fmt) \
+  KN_LOG_BEGIN(fmt) \
+    kn_log_write(kn_log_fmt, NULL, 0); \
+  } while (0)
+#define KN_LOG_1(fmt, a) \
+  KN_LOG_BEGIN(fmt) \
+    struct __attribute__((packed)) { KN_LOG_ARG(a) a0; } \
+      kn_log_args = { (a) }; \
+  KN_LOG_END
+#define KN_LOG_2(fmt, a, b) \
+  KN_LOG_BEGIN(fmt) \
+    struct __attribute__((packed)) \
+      { KN_LOG_ARG(a) a0; KN_LOG_ARG(b) a1; } \
+      kn_log_args = { (a), (b) }; \
+  KN_LOG_END
+#define KN_LOG_3(fmt, a, b, c) \
+  KN_LOG_BEGIN(fmt) \
+    struct __attribute__((packed)) \
+      { KN_LOG_ARG(a) a0; KN_LOG_ARG(b) a1; KN_LOG_ARG(c) a2; } \
+      kn_log_args = { (a), (b), (c) }; \
+  KN_LOG_END
+#define KN_LOG_4(fmt, a, b, c, d) \
+  KN_LOG_BEGIN(fmt) \
+    struct __attribute__((packed)) \
+      { KN_LOG_ARG(a) a0; KN_LOG_ARG(b) a1; KN_LOG_ARG(c) a2; \
+        KN_LOG_ARG(d) a3; } \
+      kn_log_args = { (a), (b), (c), (d) }; \
+  KN_LOG_END
+/** \endcond */
+
+/**
+ * Stores a message in the buffer, or counts it as dropped if there is no 
+ * room.  Normally called through \ref KN_LOG.
+ * 
+ * \param[in] fmt The format string, in program memory.
+ * \param[in] args The arguments.
+ * \param[in] len The size of the arguments.  A message may take at most 
+ * \ref LOG_BUFFER_SIZE bytes, including \ref LOG_HEADER_SIZE.
+ */
+extern void kn_log_write(const char* fmt, const void* args, const uint8_t len);
+
+/**
+ * A thread entry point that sends logged messages over the UART as they 
+ * arrive.  The UART must already be initialized.  The thread spends most of 
+ * its time blocked, so it may be given any id.
+ * 
+ * \param[in] my_id The id of the thread.
+ * \param[in] arg Not used.
+ */
+extern void kn_log_thread(const thread_id my_id, void* arg);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KERNEL_LOG_H_ */
@@ -0,0 +1,150 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Interface for worker thread pools.
+ * \see kernel_pool
+ */
+
+#ifndef KERNEL_POOL_H_
+#define KERNEL_POOL_H_
+
+#include "kernel_types.h"
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \defgroup kernel_pool Worker Pools
+ * \brief Runs short jobs on a set of reusable worker threads.
+ * 
+ * A pool owns a job queue and any number of worker threads.  Idle workers are 
+ * blocked until a job is posted, so running a short job costs one call to 
+ * \ref kn_pool_post instead of creating and tearing down a thread.  Jobs may 
+ * be posted from threads or from interrupts.
+ * 
+ * Each job runs to completion on a worker's stack, so the stack size of every 
+ * worker thread must be large enough for the deepest job posted to the pool.
+ * 
+ * @{
+ */
+
+/**
+ * The function type for jobs run by a pool.
+ * 
+ * \param[in] arg The parameter given to \ref kn_pool_post.
+ */
+typedef void (*job_ptr)(void* arg);
+
+/** A job waiting in a pool's queue. */
+typedef struct
+{
+  /** The function to run. */
+  job_ptr func;
+  /** The parameter passed to \c func. */
+  void* arg;
+} pool_job;
+
+/**
+ * The state of a worker pool.  The members should only be accessed through 
+ * the pool functions.
+ */
+typedef struct
+{
+  /** Ring buffer holding the queued jobs. */
+  pool_job* jobs;
+  /** The number of entries in \c jobs. */
+  uint8_t size;
+  /** The index of the oldest queued job. */
+  uint8_t head;
+  /** The number of queued jobs. */
+  volatile uint8_t count;
+  /** The worker threads that are waiting for a job. */
+  wait_list idle_workers;
+} thread_pool;
+
+/**
+ * Initializes a pool with an empty job queue and no workers.
+ * 
+ * \param[in] pool The pool to initialize.
+ * \param[in] jobs Storage for the job queue.
+ * \param[in] size The number of jobs that \c jobs can hold. Must be nonzero.
+ */
+extern void kn_pool_init(thread_pool* pool, pool_job* jobs, 
+                         const uint8_t size);
+
+/**
+ * Creates a worker thread for a pool.  The worker runs queued jobs one at a 
+ * time, and is blocked while the queue is empty.
+ * 
+ * With \ref KERNEL_USE_STACK_POOL, this is created with 
+ * \ref kn_create_thread, so \c t_id must be \c THREAD0 or an enabled thread 
+ * that keeps its stack; use \ref kn_pool_add_pooled_worker to give a new 
+ * worker a stack from the pool.
+ * 
+ * \param[in] pool The pool the worker serves.
+ * \param[in] t_id The id of the worker thread. If the thread id is an enabled 
+ * thread, that thread will be replaced.
+ * 
+ * \warning If \c t_id is the currently active thread, this function does not 
+ * return.
+ */
+extern void kn_pool_add_worker(thread_pool* pool, const thread_id t_id);
+
+#ifdef KERNEL_USE_STACK_POOL
+/**
+ * Creates a worker thread for a pool, with a stack allocated from the stack 
+ * pool by \ref kn_create_pooled_thread.
+ * 
+ * \param[in] pool The pool the worker serves.
+ * \param[in] t_id The id of the worker thread.  May not be \c THREAD0 or the 
+ * calling thread.
+ * \param[in] stack_size The size of the worker's stack, including the guard 
+ * zone.  Must be large enough for the deepest job posted to the pool.
+ * 
+ * \return False if the stack pool did not have room for the stack, in which 
+ * case no thread was changed.
+ */
+extern bool kn_pool_add_pooled_worker(thread_pool* pool, const thread_id t_id, 
+                                      const uint16_t stack_size);
+#endif
+
+/**
+ * Queues a job to run on one of a pool's workers, and wakes an idle worker 
+ * if there is one.  Does not block; may be called from an interrupt.
+ * 
+ * \param[in] pool The pool to run the job.
+ * \param[in] func The job function.
+ * \param[in] arg The parameter that will be passed to \c func.
+ * 
+ * \return True if the job was queued, or false if the queue was full.
+ */
+extern bool kn_pool_post(thread_pool* pool, job_ptr func, void* arg);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
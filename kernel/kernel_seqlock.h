@@ -0,0 +1,172 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Interface for lock-free shared data.
+ * \see kernel_seqlock
+ */
+
+#ifndef KERNEL_SEQLOCK_H_
+#define KERNEL_SEQLOCK_H_
+
+#include "kernel_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \defgroup kernel_seqlock Lock-free Shared Data
+ * \brief Sharing multi-byte values without disabling interrupts.
+ * 
+ * The AVR can only load or store one byte at a time, so a reader that is 
+ * interrupted in the middle of reading a larger value may see half of an old 
+ * value and half of a new one.  The usual fix is to disable interrupts around 
+ * the read, which delays every interrupt in the system.  The primitives here 
+ * let readers detect a torn read and try again instead.
+ * 
+ * A \ref seqlock is a counter that the writer increments before and after 
+ * each update, so that it is odd while an update is in progress.  A reader 
+ * saves the counter, copies the data, and retries if the counter was odd or 
+ * has changed since:
+ * 
+ * \code
+ * uint8_t seq;
+ * do
+ * {
+ *   seq = kn_seqlock_read_begin(&position_seq);
+ *   copy = position;
+ * } while (kn_seqlock_read_retry(&position_seq, seq));
+ * \endcode
+ * 
+ * A reader must never interrupt the writer, or it would retry forever.  This 
+ * holds when the writer is an interrupt handler and the readers are threads, 
+ * which is the common case.  A writer that runs in a thread must disable 
+ * interrupts while it writes if any interrupt handler reads the data.  Only 
+ * one writer may update the data at a time.
+ * 
+ * A \ref KN_DOUBLE_BUFFER keeps two copies of a value.  The writer fills the 
+ * copy that readers are not using and then publishes it with a single byte 
+ * store, so a reader may interrupt the writer, and only has to retry if two 
+ * writes finish during its read.  This costs twice the memory of a seqlock.
+ * 
+ * Both counters are 8 bits, so a reader that is delayed for long enough 
+ * could see the counter wrap back to the value it started with and miss an 
+ * update.  A seqlock adds 2 to its counter for each write, so this takes 
+ * exactly a multiple of 128 writes during one read.  A double buffer adds 1 
+ * for each write, so it takes a multiple of 256 writes.  In practice either 
+ * requires a reader to be preempted for far longer than any kernel thread 
+ * runs.
+ * 
+ * @{
+ */
+
+/** A sequence counter that protects data with a single writer. */
+typedef volatile uint8_t seqlock;
+
+/**
+ * Marks the start of an update.  Interrupts must not read the protected data 
+ * until \ref kn_seqlock_write_end is called.
+ * 
+ * \param[in] lock The sequence counter.
+ */
+static inline void kn_seqlock_write_begin(seqlock* const lock);
+
+/**
+ * Marks the end of an update.
+ * 
+ * \param[in] lock The sequence counter.
+ */
+static inline void kn_seqlock_write_end(seqlock* const lock);
+
+/**
+ * Starts a read of the protected data.
+ * 
+ * \param[in] lock The sequence counter.
+ * \return The value to pass to \ref kn_seqlock_read_retry.
+ */
+static inline uint8_t kn_seqlock_read_begin(const seqlock* const lock);
+
+/**
+ * Checks whether a read must be repeated.
+ * 
+ * \param[in] lock The sequence counter.
+ * \param[in] start The value returned by \ref kn_seqlock_read_begin.
+ * \return True if the data was updated during the read.
+ */
+static inline bool kn_seqlock_read_retry(const seqlock* const lock, 
+  const uint8_t start);
+
+/**
+ * Declares a double buffer holding a value of the given type.  The buffer 
+ * should be zero initialized, which is automatic for globals.
+ * 
+ * \code
+ * static KN_DOUBLE_BUFFER(struct position) latest_position;
+ * \endcode
+ * 
+ * \param[in] type The type of the value, which must be at most 255 bytes.
+ */
+#define KN_DOUBLE_BUFFER(type) \
+  struct \
+  { \
+    seqlock seq; \
+    type copies[2]; \
+  }
+
+/**
+ * Publishes a new value in a double buffer.  Only one writer may use a buffer 
+ * at a time.
+ * 
+ * \param[in] buffer A pointer to the buffer.
+ * \param[in] value A pointer to the value to publish.
+ */
+#define kn_double_buffer_write(buffer, value) \
+  kn_double_buffer_write_impl(&(buffer)->seq, (buffer)->copies, (value), \
+    sizeof((buffer)->copies[0]))
+
+/**
+ * Copies the latest value from a double buffer.  May be called from threads 
+ * or interrupts, including one that interrupted the writer.
+ * 
+ * \param[in] buffer A pointer to the buffer.
+ * \param[out] value A pointer to where the value is copied.
+ */
+#define kn_double_buffer_read(buffer, value) \
+  kn_double_buffer_read_impl(&(buffer)->seq, (buffer)->copies, (value), \
+    sizeof((buffer)->copies[0]))
+
+/** \cond */
+extern void kn_double_buffer_write_impl(seqlock* const seq, 
+  volatile void* const copies, const void* const value, const uint8_t size);
+extern void kn_double_buffer_read_impl(const seqlock* const seq, 
+  const volatile void* const copies, void* const value, const uint8_t size);
+/** \endcond */
+
+/**
+ * @}
+ */
+
+#include "core/seqlock-inl.h"
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* KERNEL_SEQLOCK_H_ */
@@ -29,7 +29,11 @@
 
 /** \cond */
 #ifndef NULL
-#define NULL ((void*)0)
+  #ifdef __cplusplus
+    #define NULL 0
+  #else
+    #define NULL ((void*)0)
+  #endif
 #endif
 /** \endcond */
 
@@ -59,13 +63,55 @@ typedef enum
  * attribute, because the compiler may generate code that assumes the stack has 
  * been set up by a function prologue.
  * 
+ * A thread function may return when its work is done.  Returning disables 
+ * the thread exactly as if it had called \ref kn_disable_self, so the thread 
+ * id may be reused by \ref kn_create_thread.
+ * 
  * \param[in] my_id The thread id of this thread.
  * \param[in] arg A parameter to pass information to the thread.
- * 
- * \warning Do not allow any thread to return: doing so will break things...
  */
 typedef void (*thread_ptr)(const thread_id my_id, void* arg);
 
+/**
+ * The function type for the idle hook.
+ * 
+ * \return True if the hook did some work, in which case the scheduler checks 
+ * for ready threads and then calls the hook again.  False if there was 
+ * nothing to do, in which case the MCU sleeps until the next interrupt.
+ * 
+ * \see kn_set_idle_hook
+ */
+typedef bool (*idle_hook_ptr)();
+
+/**
+ * A set of threads that are blocked waiting for some event, stored as a mask 
+ * of thread ids.  Each object that threads may block on (a queue, a driver, 
+ * and so on) holds a wait list, which must be initialized to 0.
+ * 
+ * \see kn_wait
+ * \see kn_signal
+ */
+typedef volatile uint8_t wait_list;
+
+/**
+ * The ways that \ref kn_notify can update a thread's notification word.
+ */
+typedef enum
+{
+  /** ORs the value into the word. */
+  NOTIFY_SET_BITS,
+  /** Adds 1 to the word, stopping at \c UINT16_MAX. */
+  NOTIFY_INCREMENT,
+  /** Replaces the word with the value. */
+  NOTIFY_OVERWRITE
+} notify_action;
+
+/**
+ * The timeout value to pass to a blocking function to wait without a time 
+ * limit.
+ */
+#define KN_WAIT_FOREVER 0
+
 /**
  * @}
  */
@@ -0,0 +1,158 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+/** \file
+ * \brief Interface for the UART driver.
+ * \see kernel_uart
+ */
+
+#ifndef KERNEL_UART_H_
+#define KERNEL_UART_H_
+
+#include "kernel_types.h"
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \defgroup kernel_uart UART Driver
+ * \brief Interrupt driven, buffered driver for USART0.
+ * 
+ * Received bytes are stored in a ring buffer by the receive complete 
+ * interrupt, and transmitted bytes are sent from a ring buffer by the data 
+ * register empty interrupt.  A thread that reads from an empty buffer, or 
+ * writes to a full one, blocks until the interrupt makes progress instead of 
+ * spinning, so other threads keep running.  The buffer sizes are set by 
+ * \ref UART_RX_BUFFER_SIZE and \ref UART_TX_BUFFER_SIZE.
+ * 
+ * The frame format is 8 data bits, no parity and 1 stop bit.  Bytes that are 
+ * received while the receive buffer is full are dropped.
+ * 
+ * @{
+ */
+
+/**
+ * A stdio stream for the UART, so that it may be used with \c printf and so 
+ * on.  Reads and writes through the stream block without a timeout.  For 
+ * example: <tt>stdout = stdin = &kn_uart_stream;</tt>
+ */
+extern FILE kn_uart_stream;
+
+/**
+ * Sets up USART0 and enables the receiver and transmitter.
+ * 
+ * \param[in] baud The baud rate.
+ */
+extern void kn_uart_init(const uint32_t baud);
+
+/**
+ * Reads one byte, blocking until a byte is received or the timeout expires.
+ * 
+ * \param[out] byte Receives the byte read.
+ * \param[in] timeout The maximum time to wait, in milliseconds, or 
+ * \ref KN_WAIT_FOREVER.
+ * 
+ * \return True if a byte was read, or false if the wait timed out.
+ */
+extern bool kn_uart_getc(uint8_t* byte, const uint16_t timeout);
+
+/**
+ * Reads \c len bytes, blocking until all of them are received or a wait times 
+ * out.
+ * 
+ * \param[out] buffer Receives the bytes read.
+ * \param[in] len The number of bytes to read.
+ * \param[in] timeout The maximum time to wait for each byte, in milliseconds, 
+ * or \ref KN_WAIT_FOREVER.
+ * 
+ * \return The number of bytes read.
+ */
+extern uint8_t kn_uart_read(void* buffer, const uint8_t len, 
+                            const uint16_t timeout);
+
+/**
+ * Returns the number of received bytes that may be read without blocking.
+ */
+extern uint8_t kn_uart_available();
+
+/**
+ * Returns the wait list that is signaled when a byte is received, so that a 
+ * thread can wait for the UART along with other sources in 
+ * \ref kn_wait_any.
+ */
+extern wait_list* kn_uart_rx_wait_list();
+
+/**
+ * Queues one byte for transmission, blocking while the transmit buffer is 
+ * full.
+ * 
+ * \param[in] byte The byte to send.
+ * \param[in] timeout The maximum time to wait for space in the buffer, in 
+ * milliseconds, or \ref KN_WAIT_FOREVER.
+ * 
+ * \return True if the byte was queued, or false if the wait timed out.
+ */
+extern bool kn_uart_putc(const uint8_t byte, const uint16_t timeout);
+
+/**
+ * Queues bytes for transmission, blocking while the transmit buffer is full.
+ * 
+ * \param[in] buffer The bytes to send.
+ * \param[in] len The number of bytes to send.
+ * \param[in] timeout The maximum time to wait for space for each byte, in 
+ * milliseconds, or \ref KN_WAIT_FOREVER.
+ * 
+ * \return The number of bytes queued.
+ */
+extern uint8_t kn_uart_write(const void* buffer, const uint8_t len, 
+                             const uint16_t timeout);
+
+/**
+ * Blocks until every queued byte has been handed to the USART.
+ * 
+ * \param[in] timeout The maximum time to wait, in milliseconds, or 
+ * \ref KN_WAIT_FOREVER.
+ * 
+ * \return True if the transmit buffer is empty, or false if the wait timed 
+ * out.
+ */
+extern bool kn_uart_flush(const uint16_t timeout);
+
+/**
+ * Sends the bytes still in the transmit buffer, and then a string, by polling 
+ * the USART.  Intended for reporting fatal errors with interrupts disabled, 
+ * such as from \ref kn_assertion_failure.
+ * 
+ * \param[in] str The string to send.
+ * 
+ * \warning Must not be called while interrupts are enabled.
+ */
+extern void kn_uart_write_polled(const char* str);
+
+/**
+ * @}
+ */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
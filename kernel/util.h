@@ -26,6 +26,32 @@
 
 #include "kernel_types.h"
 #include "kernel_debug.h"
+#include <avr/pgmspace.h>
+
+/** \def read_pm_byte
+ * Reads element \c index of a byte table stored in program memory.  On MCUs 
+ * with more than 64 KB of flash the table may be located beyond the reach of 
+ * \c lpm, so the \c elpm based far read is used instead.
+ * 
+ * \param[in] table The name of the table (not a pointer to it).
+ * \param[in] index The index of the element to read.
+ */
+/** \def read_pm_word
+ * Reads element \c index of a word (or pointer) table stored in program 
+ * memory.  See \ref read_pm_byte.
+ * 
+ * \param[in] table The name of the table (not a pointer to it).
+ * \param[in] index The index of the element to read.
+ */
+#ifdef __AVR_HAVE_ELPM__
+  #define read_pm_byte(table, index) \
+    pgm_read_byte_far(pgm_get_far_address(table) + (index))
+  #define read_pm_word(table, index) \
+    pgm_read_word_far(pgm_get_far_address(table) + 2 * (index))
+#else
+  #define read_pm_byte(table, index) pgm_read_byte(&(table)[index])
+  #define read_pm_word(table, index) pgm_read_word(&(table)[index])
+#endif
 
 /**
  * Converts a bit number to a bit mask.  For example, bit 0 produces the mask 
@@ -42,7 +68,7 @@ uint8_t bit_to_mask(uint8_t bit_num)
 {
   extern const uint8_t kn_bitmasks[8] PROGMEM;
   kn_assert(bit_num < 8);
-  return pgm_read_byte(&kn_bitmasks[bit_num]);
+  return read_pm_byte(kn_bitmasks, bit_num);
 }
 
 #endif
\ No newline at end of file
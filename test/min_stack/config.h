@@ -0,0 +1,49 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+// Configuration for the min_stack test, which builds the kernel with the 
+// largest guard zone and gives THREAD1 the smallest stack that is allowed.  
+// The kernel sources are compiled as part of this project, and this 
+// directory comes first in the include path, so the kernel's core sources 
+// find this file instead of kernel/config.h.  Everything else is taken from 
+// kernel/config.h.
+
+#ifndef MIN_STACK_CONFIG_H_
+#define MIN_STACK_CONFIG_H_
+
+#include "../../kernel/config.h"
+
+#undef STACK_GUARD_SIZE
+#define STACK_GUARD_SIZE 8
+
+// MIN_STACK_SIZE is defined in stacks.h, which is included before this is 
+// used
+#undef THREAD1_STACK_SIZE
+#define THREAD1_STACK_SIZE MIN_STACK_SIZE
+
+// the test needs both stack checks, and every tick must take the fast path
+#if !defined(KERNEL_USE_STACK_CANARY) || !defined(KERNEL_USE_STACK_CHECK)
+  #error "min_stack needs KERNEL_USE_STACK_CANARY and KERNEL_USE_STACK_CHECK"
+#endif
+#if defined(KERNEL_USE_STACK_POOL) || defined(KERNEL_USE_CYCLIC) || \
+  defined(KERNEL_USE_CRITICAL_STATS)
+  #error "min_stack needs the stack pool, cyclic executive and stats off"
+#endif
+
+#endif
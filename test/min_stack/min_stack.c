@@ -0,0 +1,101 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+// Runs a thread on the smallest stack that the kernel allows, with the 
+// largest guard zone (see config.h in this directory).  THREAD1 is entered 
+// with its whole initial frame on the stack, and yields to main from then 
+// on, so the tick interrupt checks its stack at the deepest point that a 
+// thread which uses no stack of its own can reach.  A stack overflow is 
+// reported by a rapid blink of LED13; while the test passes, pin 2 toggles 
+// every second.
+
+#include "kernel.h"
+#include "config.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+
+void minimal(const thread_id my_id, void* arg) __attribute__((OS_task));
+
+// counts the loops of THREAD1, to watch in the simulator
+static volatile uint16_t passes;
+
+#pragma GCC diagnostic ignored "-Wmain"
+void main() __attribute__((OS_main));
+void main()
+{
+  DDRD |= (1 << DDD2);
+  sei();
+  
+  kn_create_thread(THREAD1, &minimal, false, NULL);
+  
+  uint32_t last = kn_millis();
+  while (1)
+  {
+    kn_yield();
+    if (kn_millis() - last >= 1000)
+    {
+      last += 1000;
+      PORTD ^= (1 << DDD2);
+    }
+  }
+}
+
+// uses no stack besides the call to kn_yield
+void minimal(const thread_id my_id, void* arg)
+{
+  (void)my_id; (void)arg;
+  
+  while (1)
+  {
+    passes++;
+    kn_yield();
+  }
+}
+
+// slow blink LED13 for assertion failure
+void kn_assertion_failure(const char* expr, const char* file, 
+                          const char* base_file, int line)
+{
+  (void)expr; (void)file; (void)base_file; (void)line;
+  
+  cli();
+  DDRB |= (1 << DDB5);
+  
+  while (1)
+  {
+    PORTB ^= (1 << PORTB5);
+    _delay_ms(500);
+  }
+}
+
+// rapid blink LED13 for stack overflow
+void kn_stack_overflow(const thread_id t_id)
+{
+  (void)t_id;
+  
+  cli();
+  DDRB |= (1 << DDB5);
+  
+  while (1)
+  {
+    PORTB ^= (1 << PORTB5);
+    _delay_ms(250);
+  }
+}
@@ -0,0 +1,181 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+// One of a pair of programs that use the kernel in the same way, this one 
+// through the C interface and size_cpp through the C++ wrappers in 
+// kernel.hpp.  The semaphore and queue here are written out as a C program 
+// would write them, with the same logic as kn::Semaphore and kn::Queue.  The 
+// size_cpp project runs tools/size_compare.py after it builds, which fails 
+// if the two programs differ in size by more than 16 bytes.
+// 
+// With KERNEL_USE_CRITICAL_STATS the wrappers time their atomic blocks and 
+// the sizes no longer match, so the comparison assumes it is not defined.
+
+#include "kernel.h"
+#include "kernel_debug.h"
+#include "config.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#define QUEUE_SIZE 8
+
+typedef struct
+{
+  volatile uint8_t count;
+  wait_list waiters;
+} semaphore;
+
+typedef struct
+{
+  uint16_t items[QUEUE_SIZE];
+  volatile uint8_t head;
+  volatile uint8_t tail;
+  wait_list receivers;
+  wait_list senders;
+} queue;
+
+static semaphore ready;
+static queue readings;
+
+void producer(const thread_id my_id, void* arg) __attribute__((OS_task));
+
+static inline bool semaphore_take(semaphore* sem, const uint16_t timeout)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    while (sem->count == 0)
+    {
+      if (!kn_wait(&sem->waiters, timeout))
+      {
+        return false;
+      }
+    }
+    
+    sem->count--;
+  }
+  
+  return true;
+}
+
+static inline void semaphore_give(semaphore* sem)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (sem->count != UINT8_MAX)
+    {
+      sem->count++;
+    }
+    
+    kn_signal(&sem->waiters);
+  }
+}
+
+static inline bool queue_send(queue* q, const uint16_t* item, 
+                              const uint16_t timeout)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    while ((uint8_t)(q->head - q->tail) == QUEUE_SIZE)
+    {
+      if (!kn_wait(&q->senders, timeout))
+      {
+        return false;
+      }
+    }
+    
+    uint8_t head = q->head;
+    q->items[head & (QUEUE_SIZE - 1)] = *item;
+    q->head = head + 1;
+    kn_signal(&q->receivers);
+  }
+  
+  return true;
+}
+
+static inline bool queue_try_receive(queue* q, uint16_t* item)
+{
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+  {
+    if (q->head == q->tail)
+    {
+      return false;
+    }
+    
+    uint8_t tail = q->tail;
+    *item = q->items[tail & (QUEUE_SIZE - 1)];
+    q->tail = tail + 1;
+    kn_signal(&q->senders);
+  }
+  
+  return true;
+}
+
+int main() __attribute__((OS_main));
+int main()
+{
+  DDRB = 0xFF;
+  kn_create_thread(THREAD1, &producer, false, NULL);
+  
+  // copies each reading to port B
+  while (1)
+  {
+    if (semaphore_take(&ready, 100))
+    {
+      uint16_t reading;
+      while (queue_try_receive(&readings, &reading))
+      {
+        PORTB = (uint8_t)reading;
+      }
+    }
+    
+    kn_yield_if_needed();
+  }
+}
+
+// queues the timer count every 10 ms
+void producer(const thread_id my_id, void* arg)
+{
+  (void)my_id; (void)arg;
+  
+  while (1)
+  {
+    uint16_t reading = TCNT0;
+    queue_send(&readings, &reading, KN_WAIT_FOREVER);
+    semaphore_give(&ready);
+    kn_sleep(10);
+  }
+}
+
+void kn_assertion_failure(const char* expr, const char* file, 
+                          const char* base_file, int line)
+{
+  (void)expr; (void)file; (void)base_file; (void)line;
+  
+  cli();
+  while (1);
+}
+
+void kn_stack_overflow(const thread_id t_id)
+{
+  (void)t_id;
+  
+  cli();
+  while (1);
+}
@@ -0,0 +1,89 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+// One of a pair of programs that use the kernel in the same way, this one 
+// through the C++ wrappers in kernel.hpp and size_c through the C interface.  
+// This project runs tools/size_compare.py after it builds, which fails if 
+// the two programs differ in size by more than 16 bytes.
+
+#include "kernel.hpp"
+#include "kernel_debug.h"
+#include "config.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+void producer(const thread_id my_id, void* arg) __attribute__((OS_task));
+
+typedef kn::Thread<THREAD1, &producer> Producer;
+
+static kn::Semaphore ready;
+static kn::Queue<uint16_t, 8> readings;
+
+int main() __attribute__((OS_main));
+int main()
+{
+  DDRB = 0xFF;
+  Producer::create();
+  
+  // copies each reading to port B
+  while (1)
+  {
+    if (ready.take(100))
+    {
+      uint16_t reading;
+      while (readings.try_receive(reading))
+      {
+        PORTB = (uint8_t)reading;
+      }
+    }
+    
+    kn::this_thread::yield_if_needed();
+  }
+}
+
+// queues the timer count every 10 ms
+void producer(const thread_id my_id, void* arg)
+{
+  (void)my_id; (void)arg;
+  
+  while (1)
+  {
+    uint16_t reading = TCNT0;
+    readings.send(reading);
+    ready.give();
+    kn::this_thread::sleep(10);
+  }
+}
+
+void kn_assertion_failure(const char* expr, const char* file, 
+                          const char* base_file, int line)
+{
+  (void)expr; (void)file; (void)base_file; (void)line;
+  
+  cli();
+  while (1);
+}
+
+void kn_stack_overflow(const thread_id t_id)
+{
+  (void)t_id;
+  
+  cli();
+  while (1);
+}
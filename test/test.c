@@ -18,10 +18,12 @@
 ******************************************************************************/
 
 #include "kernel.h"
+#include "kernel_uart.h"
 #include "config.h"
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <util/delay.h>
+#include <stdlib.h>
 
 
 void threadA(const thread_id my_id, void* arg) 
@@ -36,6 +38,7 @@ void main() __attribute__((OS_main));
 void main()
 {
   DDRD |= (1 << DDD2) | (1 << DDD3) | (1 << DDD4);
+  kn_uart_init(57600);
   sei();
   
   kn_create_thread(THREAD1, &threadB, false, NULL);
@@ -85,14 +88,22 @@ void threadC(const thread_id my_id, void* arg)
   }
 }
 
-// slow blink LED13 for assert failure
-// TODO: send assert message over serial
+// report assert failure over serial, then slow blink LED13
 void kn_assertion_failure(const char* expr, const char* file, 
                           const char* base_file, int line)
 {
-  (void)expr; (void)file; (void)base_file; (void)line;
+  char line_str[7];
+  (void)base_file;
   
   cli();
+  kn_uart_write_polled("assertion failed: ");
+  kn_uart_write_polled(expr);
+  kn_uart_write_polled(" at ");
+  kn_uart_write_polled(file);
+  kn_uart_write_polled(":");
+  kn_uart_write_polled(itoa(line, line_str, 10));
+  kn_uart_write_polled("\r\n");
+  
   DDRB |= (1 << DDB5);
   
   while (1)
@@ -0,0 +1,128 @@
+/******************************************************************************
+  avr-kernel
+  Copyright (C) 2014 Michael Crawford
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+******************************************************************************/
+
+// Measures the cycles taken by the kernel's timer interrupt.
+// 
+// Timer1 counts every cycle while the only thread polls it in a tight loop 
+// with interrupts enabled.  Most passes through the loop take the same time; 
+// a longer pass was interrupted, and the extra time is the cost of the 
+// interrupt, from the 4 cycle interrupt response to the reti.  The tick is 
+// the only interrupt that fires, and no thread sleeps, so every tick 
+// takes the fast path.  Change config.h to measure other configurations.
+// 
+// Every 1000 ticks the shortest and longest tick are written to the USART at 
+// 57600 baud.  The shortest should be the count given in kernel_asm.s plus 
+// the 4 cycles of the interrupt response; the longest also carries into the 
+// upper bytes of the system counter.  The count in kernel_asm.s was made by 
+// hand from the instruction timings, and this program has not been run to 
+// confirm it.
+
+#include "kernel.h"
+#include "kernel_uart.h"
+#include "config.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdlib.h>
+
+#define TICKS_PER_REPORT 1000
+
+static void report(const char* label, const uint16_t value);
+
+#pragma GCC diagnostic ignored "-Wmain"
+void main() __attribute__((OS_main));
+void main()
+{
+  // Timer1 runs freely at clk/1
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  kn_uart_init(57600);
+  sei();
+  
+  while (1)
+  {
+    uint16_t pass = UINT16_MAX;
+    uint16_t shortest = UINT16_MAX;
+    uint16_t longest = 0;
+    uint16_t ticks = 0;
+    uint32_t start = kn_millis();
+    uint16_t last = TCNT1;
+    
+    while (ticks < TICKS_PER_REPORT)
+    {
+      uint16_t now = TCNT1;
+      uint16_t gap = now - last;
+      last = now;
+      
+      // the shortest gap is one uninterrupted pass, and is found long 
+      // before the first tick
+      if (gap < pass)
+      {
+        pass = gap;
+      }
+      else if (gap > pass + 8)
+      {
+        gap -= pass;
+        if (gap < shortest)
+        {
+          shortest = gap;
+        }
+        if (gap > longest)
+        {
+          longest = gap;
+        }
+        ticks++;
+        // don't count the time taken here against the next pass
+        last = TCNT1;
+      }
+    }
+    
+    report("ms ", (uint16_t)(kn_millis() - start));
+    report(" loop ", pass);
+    report(" tick min ", shortest);
+    report(" max ", longest);
+    kn_uart_write_polled("\r\n");
+  }
+}
+
+void report(const char* label, const uint16_t value)
+{
+  char str[6];
+  
+  kn_uart_write_polled(label);
+  kn_uart_write_polled(utoa(value, str, 10));
+}
+
+void kn_assertion_failure(const char* expr, const char* file, 
+                          const char* base_file, int line)
+{
+  (void)expr; (void)file; (void)base_file; (void)line;
+  
+  cli();
+  kn_uart_write_polled("assertion failed\r\n");
+  while (1);
+}
+
+void kn_stack_overflow(const thread_id t_id)
+{
+  (void)t_id;
+  
+  cli();
+  kn_uart_write_polled("stack overflow\r\n");
+  while (1);
+}
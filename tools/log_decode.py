@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+#
+# avr-kernel
+# Copyright (C) 2014 Michael Crawford
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+
+"""Decodes the messages sent by the kernel's deferred logger.
+
+KN_LOG stores only the flash address of its format string, so the strings are
+read here from the program's ELF file, and the messages are formatted with the
+logged time and thread id.  The input is the raw byte stream from the UART,
+read from a file, a serial device that has already been configured, or stdin.
+
+Each message is a sync byte (0xA5), the length of the arguments, the format
+address (2 bytes), the time in milliseconds (4 bytes), the thread id and the
+arguments, all little endian.  Bytes that do not start a message are skipped,
+so decoding can begin in the middle of a stream.
+
+Example:
+  stty -F /dev/ttyUSB0 115200 raw
+  log_decode.py --elf test/Debug/test.elf /dev/ttyUSB0
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+LOG_SYNC = 0xA5
+HEADER = struct.Struct('<BHIB')
+
+# the largest LOG_BUFFER_SIZE
+MAX_MESSAGE_SIZE = 128
+
+# the sections that are loaded into RAM have addresses above this in the ELF
+AVR_DATA_OFFSET = 0x800000
+
+SHT_PROGBITS = 1
+
+CONVERSION_RE = re.compile(
+  r'%([-+ #0]*)(\d*|\*)(\.\d+)?(hh|h|l|ll)?([diouxXcsSpfFeEgGaA%])')
+
+
+def parse_args():
+  parser = argparse.ArgumentParser(
+    description='Formats the messages sent by the kernel logger.',
+    formatter_class=argparse.RawDescriptionHelpFormatter,
+    epilog=__doc__)
+  parser.add_argument('--elf', required=True,
+                      help='the linked program that sent the messages')
+  parser.add_argument('input', nargs='?', default='-',
+                      help='the logged byte stream (default stdin)')
+  return parser.parse_args()
+
+
+def read_flash(path):
+  """Returns the sections of the ELF file that are in flash."""
+  with open(path, 'rb') as elf:
+    data = elf.read()
+  if data[:4] != b'\x7fELF' or data[4] != 1 or data[5] != 1:
+    sys.exit('error: %s is not a little endian 32 bit ELF file' % path)
+  shoff, = struct.unpack_from('<I', data, 32)
+  shentsize, shnum = struct.unpack_from('<HH', data, 46)
+  sections = []
+  for i in range(shnum):
+    _, kind, _, addr, offset, size = struct.unpack_from(
+      '<IIIIII', data, shoff + i * shentsize)
+    if kind == SHT_PROGBITS and addr < AVR_DATA_OFFSET and size:
+      sections.append((addr, data[offset:offset + size]))
+  return sections
+
+
+def read_string(flash, address):
+  for addr, contents in flash:
+    if addr <= address < addr + len(contents):
+      start = address - addr
+      end = contents.find(b'\0', start)
+      if end < 0:
+        end = len(contents)
+      return contents[start:end].decode('latin-1')
+  return None
+
+
+def format_message(fmt, args):
+  """Applies a printf format to the argument bytes as avr-gcc passes them."""
+  out = []
+  pos = 0
+  offset = 0
+  for match in CONVERSION_RE.finditer(fmt):
+    out.append(fmt[pos:match.start()])
+    pos = match.end()
+    flags, width, precision, length, conv = match.groups()
+    if conv == '%':
+      out.append('%')
+      continue
+    if width == '*':
+      return None
+    # int and pointers are 2 bytes, long and float are 4 (double is float)
+    size = 4 if length in ('l', 'll') or conv in 'fFeEgGaA' else 2
+    if offset + size > len(args):
+      return None
+    raw = args[offset:offset + size]
+    offset += size
+    spec = '%' + flags + width + (precision or '')
+    if conv in 'fFeEgGaA':
+      value, = struct.unpack('<f', raw)
+      out.append((spec + ('g' if conv in 'aA' else conv)) % value)
+    elif conv in 'di':
+      value = int.from_bytes(raw, 'little', signed=True)
+      out.append((spec + 'd') % value)
+    elif conv == 'c':
+      out.append((spec + 'c') % chr(raw[0]))
+    else:
+      value = int.from_bytes(raw, 'little')
+      # strings are in RAM, so only their address is known
+      if conv in 'psS':
+        spec, conv = '%#', 'x'
+      out.append((spec + ('d' if conv == 'u' else conv)) % value)
+  if offset != len(args):
+    return None
+  out.append(fmt[pos:])
+  return ''.join(out)
+
+
+def decode(stream, flash, output):
+  buffer = b''
+  ended = False
+  while True:
+    # skip to the next sync byte
+    start = buffer.find(bytes([LOG_SYNC]))
+    buffer = buffer[start:] if start >= 0 else b''
+    needed = 1 + HEADER.size + buffer[1] if len(buffer) >= 2 else 2
+    if needed > 1 + MAX_MESSAGE_SIZE:
+      buffer = buffer[1:]
+      continue
+    if len(buffer) < needed:
+      more = stream.read(needed - len(buffer)) if not ended else b''
+      if more:
+        buffer += more
+      elif buffer:
+        # the stream ended inside a false message, so try past its sync byte
+        ended = True
+        buffer = buffer[1:]
+      else:
+        return
+      continue
+
+    length, address, millis, thread = HEADER.unpack_from(buffer, 1)
+    args = buffer[1 + HEADER.size:needed]
+    if address == 0 and length == 2:
+      text = '%d messages dropped' % int.from_bytes(args, 'little')
+    else:
+      fmt = read_string(flash, address)
+      text = None if fmt is None else format_message(fmt, args)
+    if text is None:
+      # not a real message, so look for the next sync byte
+      buffer = buffer[1:]
+      continue
+    output.write('%10.3f [%d] %s\n' % (millis / 1000.0, thread, text))
+    output.flush()
+    buffer = buffer[needed:]
+
+
+def main():
+  args = parse_args()
+  flash = read_flash(args.elf)
+  if args.input == '-':
+    decode(sys.stdin.buffer, flash, sys.stdout)
+  else:
+    with open(args.input, 'rb', buffering=0) as stream:
+      decode(stream, flash, sys.stdout)
+
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+#
+# avr-kernel
+# Copyright (C) 2014 Michael Crawford
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+"""Checks that two builds of the same program have the same size.
+
+Used by the test/size_c and test/size_cpp projects, which use the kernel in
+the same way through the C interface and the C++ wrappers in kernel.hpp.
+Runs avr-size on both ELF files, prints the size of the text, data and bss
+sections of each, and exits with status 1 if any section differs by more
+than the given tolerance.
+
+Example:
+  size_compare.py test/size_c/Release/size_c.elf \\
+    test/size_cpp/Release/size_cpp.elf
+"""
+
+import argparse
+import subprocess
+import sys
+
+SECTIONS = ('text', 'data', 'bss')
+
+
+def parse_args():
+  parser = argparse.ArgumentParser(
+    description='Compares the section sizes of two programs.',
+    formatter_class=argparse.RawDescriptionHelpFormatter,
+    epilog=__doc__)
+  parser.add_argument('reference',
+                      help='the program to compare against')
+  parser.add_argument('program',
+                      help='the program that must match it')
+  parser.add_argument('--tolerance', type=int, default=0,
+                      help='the largest allowed difference, in bytes')
+  parser.add_argument('--size', default='avr-size',
+                      help='the size program to use')
+  return parser.parse_args()
+
+
+def read_sizes(size, elf):
+  """Returns the text, data and bss sizes of a program."""
+  output = subprocess.run([size, '--format=berkeley', elf], check=True,
+                          stdout=subprocess.PIPE,
+                          universal_newlines=True).stdout
+  lines = output.splitlines()
+  if len(lines) < 2:
+    sys.exit('error: unexpected output from %s: %s' % (size, output))
+  fields = lines[1].split()
+  return dict(zip(SECTIONS, (int(field) for field in fields[:3])))
+
+
+def main():
+  args = parse_args()
+  reference = read_sizes(args.size, args.reference)
+  program = read_sizes(args.size, args.program)
+
+  status = 0
+  for section in SECTIONS:
+    difference = program[section] - reference[section]
+    print('%-4s %6d %6d %+d' % (section, reference[section],
+                                program[section], difference))
+    if abs(difference) > args.tolerance:
+      print('error: %s of %s differs from %s by %d bytes'
+            % (section, args.program, args.reference, difference),
+            file=sys.stderr)
+      status = 1
+  return status
+
+
+if __name__ == '__main__':
+  sys.exit(main())
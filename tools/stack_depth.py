@@ -0,0 +1,370 @@
+#!/usr/bin/env python3
+#
+# avr-kernel
+# Copyright (C) 2014 Michael Crawford
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program; if not, write to the Free Software Foundation, Inc.,
+# 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+
+"""Static stack depth analysis for kernel threads.
+
+Finds the worst case stack usage of each thread from the .su files written by
+gcc's -fstack-usage option and the call graph in the disassembly of the linked
+program, and writes a header that defines THREADn_MIN_STACK_SIZE for each
+thread.  The exit status is 1 if any THREADn_STACK_SIZE in config.h is smaller
+than the computed minimum, so the script can be used as a post-build step.
+
+The minimum for a thread is the deepest call chain from its entry points,
+which includes the context saved when the thread yields, but never less than
+INITIAL_STACK_USAGE.  The worst case interrupt frame and the guard zone are
+added on top, since an interrupt may arrive at any point.
+
+An interrupt handler that enables interrupts, directly or in a function it
+calls, can itself be interrupted.  This covers handlers defined with
+KN_NESTABLE_ISR, and the kernel tick when it runs cyclic executive tasks.
+The worst case interrupt frame is the sum of the frames of all such
+handlers, plus the deepest frame of any handler that can nest on top of
+them.  A handler that enables interrupts cannot interrupt itself, except for
+the tick, which nests once to detect an overrun; that nested tick is sized
+without the indirect calls (the tasks) it makes only when it is not nested.
+
+Functions that have no .su entry (assembly and library code) are sized from
+their push instructions and frame pointer adjustment, and are listed so the
+estimates can be checked.  Use --frame to override any size.  Indirect calls
+cannot be followed; each function that makes them must be given its possible
+targets with --indirect, or an empty list if the calls do not use the thread's
+stack.
+
+Example:
+  stack_depth.py --elf test/Debug/test.elf --su-dir test/Debug \\
+    --su-dir kernel/Debug --config kernel/config.h \\
+    --thread 0=main,threadA --thread 1=threadB --thread 2=threadC \\
+    --output test/Debug/stack_sizes.h
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+# the scheduler calls the idle hook after switching to the idle stack
+DEFAULT_INDIRECT = {'kn_scheduler': []}
+
+FUNC_RE = re.compile(r'^[0-9a-f]+ <([^>]+)>:$')
+INSN_RE = re.compile(r'^\s*[0-9a-f]+:\s+(?:[0-9a-f]{2} )+\s*(\S+)\s*(.*)$')
+TARGET_RE = re.compile(r'<([^>+]+)(\+0x[0-9a-f]+)?>')
+FRAME_RE = re.compile(r'r28, (0x[0-9A-Fa-f]+|\d+)')
+
+
+class Function:
+  def __init__(self, name):
+    self.name = name
+    self.pushes = 0
+    self.frame = 0
+    self.calls = set()
+    self.indirect = False
+    self.falls_through = True
+    self.insns = 0
+    self.enables = False
+
+
+def parse_args():
+  parser = argparse.ArgumentParser(
+    description='Computes the minimum stack size for each kernel thread.',
+    formatter_class=argparse.RawDescriptionHelpFormatter,
+    epilog=__doc__)
+  parser.add_argument('--elf', required=True,
+                      help='the linked program')
+  parser.add_argument('--su-dir', action='append', default=[],
+                      help='directory searched recursively for .su files')
+  parser.add_argument('--config', required=True,
+                      help='the kernel config.h')
+  parser.add_argument('--thread', action='append', default=[],
+                      metavar='N=FUNC[,FUNC...]',
+                      help='the entry points of thread N')
+  parser.add_argument('--indirect', action='append', default=[],
+                      metavar='FUNC=[TARGET,...]',
+                      help='the targets of the indirect calls in FUNC')
+  parser.add_argument('--frame', action='append', default=[],
+                      metavar='FUNC=BYTES',
+                      help='the stack usage of FUNC, excluding its callees')
+  parser.add_argument('--pc-bytes', type=int, choices=(2, 3), default=2,
+                      help='size of a return address (3 on the ATmega2560)')
+  parser.add_argument('--objdump', default='avr-objdump',
+                      help='the objdump program to use')
+  parser.add_argument('--output',
+                      help='the header to write')
+  return parser.parse_args()
+
+
+def split_assignment(text, option):
+  if '=' not in text:
+    sys.exit('error: expected NAME=VALUE for %s, got "%s"' % (option, text))
+  name, value = text.split('=', 1)
+  return name.strip(), value.strip()
+
+
+def read_stack_usage(dirs):
+  """Returns the static stack usage of each function in the .su files."""
+  usage = {}
+  for top in dirs:
+    for root, _, files in os.walk(top):
+      for name in files:
+        if not name.endswith('.su'):
+          continue
+        with open(os.path.join(root, name)) as su:
+          for line in su:
+            fields = line.rstrip('\n').split('\t')
+            if len(fields) < 3:
+              continue
+            func = fields[0].rsplit(':', 1)[-1]
+            size = int(fields[1])
+            if 'dynamic' in fields[2] and 'bounded' not in fields[2]:
+              print('warning: %s has dynamic stack usage' % func,
+                    file=sys.stderr)
+            # static functions in different files may share a name
+            usage[func] = max(size, usage.get(func, 0))
+  return usage
+
+
+def read_call_graph(objdump, elf):
+  """Returns the functions in the program, with their calls and pushes."""
+  output = subprocess.run([objdump, '-d', elf], check=True, stdout=subprocess.PIPE,
+                          universal_newlines=True).stdout
+  functions = {}
+  order = []
+  func = None
+  for line in output.splitlines():
+    match = FUNC_RE.match(line)
+    if match:
+      func = Function(match.group(1))
+      functions[func.name] = func
+      order.append(func)
+      continue
+    match = INSN_RE.match(line)
+    if not match or func is None:
+      continue
+    op, operands = match.group(1), match.group(2)
+    func.insns += 1
+    func.falls_through = op not in ('ret', 'reti', 'jmp', 'rjmp', 'ijmp',
+                                    'eijmp')
+    if op == 'push':
+      func.pushes += 1
+    elif op == 'sei':
+      func.enables = True
+    elif op in ('icall', 'eicall', 'ijmp', 'eijmp'):
+      func.indirect = True
+    elif op in ('sbiw', 'subi') and func.insns < 24:
+      # frame allocation in the prologue
+      frame = FRAME_RE.search(operands)
+      if frame:
+        func.frame = max(func.frame, int(frame.group(1), 0))
+    if op in ('call', 'rcall', 'jmp', 'rjmp'):
+      target = TARGET_RE.search(operands)
+      # branches within a function, or into the middle of another one, are 
+      # not calls
+      if target and not target.group(2) and target.group(1) != func.name:
+        func.calls.add(target.group(1))
+
+  # assembly functions may fall through into the next symbol
+  for func, following in zip(order, order[1:]):
+    if func.falls_through and func.insns:
+      func.calls.add(following.name)
+  return functions
+
+
+def read_config(path):
+  """Returns the macros defined in config.h, ignoring commented lines."""
+  macros = {}
+  with open(path) as config:
+    for line in config:
+      match = re.match(r'\s*#define\s+(\w+)(?:\s+(.*?))?\s*(?://.*)?$', line)
+      if match:
+        macros[match.group(1)] = (match.group(2) or '').strip()
+  return macros
+
+
+class Analysis:
+  def __init__(self, functions, usage, indirect, frames, pc_bytes,
+               follow_indirect=True):
+    self.functions = functions
+    self.usage = usage
+    self.indirect = indirect
+    self.frames = frames
+    self.pc_bytes = pc_bytes
+    self.follow_indirect = follow_indirect
+    self.depths = {}
+    self.enabling = {}
+    self.estimated = set()
+    self.errors = []
+
+  def frame(self, name):
+    if name in self.frames:
+      return self.frames[name]
+    if name in self.usage:
+      return self.usage[name]
+    func = self.functions.get(name)
+    if func is None:
+      return self.pc_bytes
+    if func.pushes or func.frame:
+      self.estimated.add(name)
+    return self.pc_bytes + func.pushes + func.frame
+
+  def depth(self, name, path=()):
+    """Returns the worst case stack usage of a function and its callees."""
+    if name in self.depths:
+      return self.depths[name]
+    if name in path:
+      self.errors.append('recursion: %s' % ' -> '.join(path + (name,)))
+      return 0
+    func = self.functions.get(name)
+    if func is None:
+      self.errors.append('%s not found in the program' % name)
+      return 0
+
+    deepest = 0
+    for callee in self.callees(func):
+      deepest = max(deepest, self.depth(callee, path + (name,)))
+    self.depths[name] = self.frame(name) + deepest
+    return self.depths[name]
+
+  def callees(self, func):
+    callees = set(func.calls)
+    if func.indirect and self.follow_indirect:
+      if func.name in self.indirect:
+        callees.update(self.indirect[func.name])
+      else:
+        self.errors.append('%s makes indirect calls; use --indirect'
+                           % func.name)
+    return callees
+
+  def enables_interrupts(self, name):
+    """Returns true if a function or any of its callees executes sei."""
+    if name in self.enabling:
+      return self.enabling[name]
+    # assume not while the function is being visited, to end recursion
+    self.enabling[name] = False
+    func = self.functions.get(name)
+    enables = False
+    if func is not None:
+      enables = func.enables or any(self.enables_interrupts(callee)
+                                    for callee in self.callees(func))
+    self.enabling[name] = enables
+    return enables
+
+
+def main():
+  args = parse_args()
+  pc = args.pc_bytes
+
+  indirect = dict(DEFAULT_INDIRECT)
+  for text in args.indirect:
+    name, value = split_assignment(text, '--indirect')
+    indirect[name] = [t.strip() for t in value.split(',') if t.strip()]
+  frames = {}
+  for text in args.frame:
+    name, value = split_assignment(text, '--frame')
+    frames[name] = int(value, 0)
+  threads = {}
+  for text in args.thread:
+    thread, value = split_assignment(text, '--thread')
+    threads[int(thread)] = [e.strip() for e in value.split(',') if e.strip()]
+  if not threads:
+    sys.exit('error: no threads given')
+
+  analysis = Analysis(read_call_graph(args.objdump, args.elf),
+                      read_stack_usage(args.su_dir), indirect, frames, pc)
+
+  # the frames of handlers when they are interrupted before they can make 
+  # any indirect calls
+  plain = Analysis(analysis.functions, analysis.usage, indirect, frames, pc,
+                   follow_indirect=False)
+
+  # interrupts run on the stack of whichever thread they interrupt
+  # handlers that enable interrupts can all be active at once, and any 
+  # handler can be the innermost
+  vectors = [name for name in sorted(analysis.functions)
+             if re.match(r'^__vector_\d+$', name)]
+  nesting = [name for name in vectors if analysis.enables_interrupts(name)]
+  nested_frame = sum(analysis.depth(name) for name in nesting)
+  innermost = 0
+  innermost_name = None
+  for name in vectors:
+    if name in nesting:
+      # only the tick can be innermost while it is also active further out, 
+      # and it then returns before it starts a task; sizing other handlers 
+      # this way as well only overestimates
+      depth = plain.depth(name)
+    else:
+      depth = analysis.depth(name)
+    if depth > innermost:
+      innermost, innermost_name = depth, name
+  isr_frame = nested_frame + innermost
+
+  config = read_config(args.config)
+  guard = 0
+  if 'KERNEL_USE_STACK_CANARY' in config:
+    guard = int(config.get('STACK_GUARD_SIZE', '0'), 0)
+  initial = 3 * pc + 21
+
+  for name in nesting:
+    print('nesting interrupt: %d bytes (%s)' % (analysis.depth(name), name))
+  print('worst case interrupt: %d bytes (%s innermost)'
+        % (isr_frame, innermost_name))
+  minimums = {}
+  for thread in sorted(threads):
+    depth = 0
+    for entry in threads[thread]:
+      depth = max(depth, analysis.depth(entry))
+    minimums[thread] = max(depth, initial) + isr_frame + guard
+    print('THREAD%d: call depth %d bytes, minimum stack %d bytes'
+          % (thread, depth, minimums[thread]))
+
+  for name in sorted(analysis.estimated):
+    print('note: %s sized from its disassembly (%d bytes)'
+          % (name, analysis.frame(name)), file=sys.stderr)
+  if analysis.errors:
+    for error in dict.fromkeys(analysis.errors):
+      print('error: %s' % error, file=sys.stderr)
+    return 1
+
+  if args.output:
+    with open(args.output, 'w') as header:
+      header.write('/* Generated by tools/stack_depth.py, do not edit. */\n')
+      header.write('\n#ifndef KERNEL_STACK_SIZES_H_\n')
+      header.write('#define KERNEL_STACK_SIZES_H_\n\n')
+      for thread in sorted(minimums):
+        header.write('#define THREAD%d_MIN_STACK_SIZE %d\n'
+                     % (thread, minimums[thread]))
+      header.write('\n#endif /* KERNEL_STACK_SIZES_H_ */\n')
+
+  status = 0
+  for thread in sorted(minimums):
+    macro = 'THREAD%d_STACK_SIZE' % thread
+    if macro not in config:
+      print('error: %s is not defined in %s' % (macro, args.config),
+            file=sys.stderr)
+      status = 1
+      continue
+    size = int(config[macro], 0)
+    if size < minimums[thread]:
+      print('error: %s is %d, but THREAD%d needs %d bytes'
+            % (macro, size, thread, minimums[thread]), file=sys.stderr)
+      status = 1
+  return status
+
+
+if __name__ == '__main__':
+  sys.exit(main())